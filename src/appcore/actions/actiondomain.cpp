@@ -1,20 +1,43 @@
 #include "actiondomain.h"
 #include "actiondomain_p.h"
 
+#include <algorithm>
+#include <cstring>
+#include <functional>
 #include <utility>
 
+#include <QCryptographicHash>
+#include <QApplication>
+#include <QBuffer>
+#include <QDir>
+#include <QFile>
 #include <QFileInfo>
+#include <QFutureInterface>
+#include <QFutureWatcher>
+#include <QGuiApplication>
+#include <QIconEngine>
+#include <QImageReader>
+#include <QPainter>
+#include <QPixmapCache>
+#include <QStyle>
+#include <QStyleOption>
 #include <QRegularExpression>
+#include <QSaveFile>
 #include <QJsonObject>
 #include <QJsonDocument>
 #include <QJsonArray>
 #include <QMetaProperty>
-#include <QQueue>
 #include <QStringView>
+#include <QtEndian>
+#include <QtConcurrentMap>
+#include <QtConcurrentRun>
 
 #include <qmxmladaptor.h>
 
 #include "actionitem_p.h"
+#include "actionextension_p.h"
+
+Q_DECLARE_METATYPE(QList<QPointer<QAction>>)
 
 namespace Core {
 
@@ -122,7 +145,7 @@ namespace Core {
                         }
                     }
 
-                    for (const auto &child : item->children) {
+                    for (const auto &child : e->children) {
                         stack.push_back(child.data());
                     }
                 }
@@ -248,13 +271,134 @@ namespace Core {
 
 
 
+    // One event filter of the application shared by the domains living on its thread
+    class LanguageChangeWatcher : public QObject {
+    public:
+        QList<ActionDomainPrivate *> domains;
+
+        static LanguageChangeWatcher *instance() {
+            return self;
+        }
+
+        static LanguageChangeWatcher *create(QCoreApplication *app) {
+            if (!self)
+                self = new LanguageChangeWatcher(app);
+            return self;
+        }
+
+    protected:
+        bool eventFilter(QObject *obj, QEvent *event) override {
+            if (event->type() == QEvent::LanguageChange && obj == parent()) {
+                for (const auto &d : std::as_const(domains)) {
+                    d->languageChanged();
+                }
+            }
+            return QObject::eventFilter(obj, event);
+        }
+
+    private:
+        explicit LanguageChangeWatcher(QCoreApplication *app) : QObject(app) {
+            app->installEventFilter(this);
+        }
+
+        static QPointer<LanguageChangeWatcher> self;
+    };
+
+    QPointer<LanguageChangeWatcher> LanguageChangeWatcher::self;
+
     ActionDomainPrivate::ActionDomainPrivate()
         : sharedStretchWidgetAction(new StretchWidgetAction()),
           sharedMenuItem(new ActionItem(
               {}, ActionItem::MenuFactory([](QWidget *parent) { return new QMenu(parent); }))) {
     }
-    ActionDomainPrivate::~ActionDomainPrivate() = default;
+    ActionDomainPrivate::~ActionDomainPrivate() {
+        if (auto watcher = LanguageChangeWatcher::instance())
+            watcher->domains.removeOne(this);
+    }
     void ActionDomainPrivate::init() {
+        Q_Q(ActionDomain);
+
+        // Watch for the translators being changed
+        if (auto app = QCoreApplication::instance(); app && app->thread() == q->thread()) {
+            LanguageChangeWatcher::create(app)->domains.append(this);
+        }
+    }
+    void ActionDomainPrivate::languageChanged() {
+        Q_Q(ActionDomain);
+        searchIndex.reset();
+
+        // After the event is through, the cached translations are dropped by then
+        if (translationPrefill) {
+            QMetaObject::invokeMethod(
+                q, [this]() { prefillTranslations(); }, Qt::QueuedConnection);
+        }
+    }
+    void ActionDomainPrivate::prefillTranslations() const {
+        // The cache only keeps the results once its watcher is installed
+        if (!watchActionTranslations())
+            return;
+
+        QSet<QByteArray> texts;
+        QSet<QByteArray> commandClasses;
+        QSet<QByteArray> categories;
+        for (auto it = objectInfoMap.begin(); it != objectInfoMap.end(); ++it) {
+            const auto &info = it.value();
+            texts.insert(info.text());
+            commandClasses.insert(info.commandClass());
+            for (const auto &category : info.categories()) {
+                categories.insert(category);
+            }
+        }
+
+        // The translators are thread-safe, the results land in the shared cache
+        QtConcurrent::run([texts, commandClasses, categories]() {
+            for (const auto &text : texts) {
+                ActionObjectInfo::translatedText(text);
+            }
+            for (const auto &commandClass : commandClasses) {
+                ActionObjectInfo::translatedCommandClass(commandClass);
+            }
+            for (const auto &category : categories) {
+                ActionObjectInfo::translatedCategory(category);
+            }
+        });
+    }
+    QMetaProperty ActionDomainPrivate::standaloneProperty(QObject *obj,
+                                                          StandaloneProperty which) const {
+        static const char *const names[] = {"text", "icon"};
+
+        // Looked up once per class
+        auto mo = obj->metaObject();
+        auto &cache = standaloneProperties[which];
+        auto it = cache.find(mo);
+        if (it == cache.end()) {
+            int idx = mo->indexOfProperty(names[which]);
+            if (idx >= 0 && !mo->property(idx).isWritable())
+                idx = -1;
+            it = cache.insert(mo, idx);
+        }
+        return it.value() < 0 ? QMetaProperty() : mo->property(it.value());
+    }
+    QStringList ActionDomainPrivate::searchTexts(const ActionObjectInfo &info) {
+        auto text = ActionObjectInfo::translatedText(info.text());
+        QStringList categories;
+        for (const auto &category : info.categories()) {
+            categories.append(ActionObjectInfo::translatedCategory(category));
+        }
+        return {
+            text.isEmpty() ? info.id() : text,
+            categories.join(QLatin1Char(' ')),
+            ActionObjectInfo::translatedCommandClass(info.commandClass()),
+        };
+    }
+    void ActionDomainPrivate::flushSearchIndex() const {
+        if (searchIndex)
+            return;
+
+        searchIndex.reset(new ActionSearchIndex());
+        for (auto it = objectInfoMap.begin(); it != objectInfoMap.end(); ++it) {
+            searchIndex->insert(it.key(), searchTexts(it.value()));
+        }
     }
     void ActionDomainPrivate::flushCatalog() const {
         if (catalog)
@@ -300,61 +444,321 @@ namespace Core {
         catalog = root->toCatalog(heap);
     }
 
-    class LayoutsHelper {
+    void ActionDomainPrivate::insertCatalogItem(ActionCatalog &root, const ActionObjectInfo &info) {
+        // Same as a full build with the item appended
+        auto p = &root;
+        for (const auto &c : info.categories()) {
+            auto &data = *p->d;
+            int idx = data.indexes.value(c, -1);
+            if (idx < 0) {
+                idx = data.children.size();
+                data.children.append(ActionCatalog(c));
+                data.indexes.insert(c, idx);
+            }
+            p = &data.children[idx];
+        }
+        p->d->id = info.id();
+    }
+
+    bool ActionDomainPrivate::removeCatalogItem(ActionCatalog &root, const ActionObjectInfo &info) {
+        QVector<ActionCatalog *> path = {&root};
+        for (const auto &c : info.categories()) {
+            auto &data = *path.back()->d;
+            int idx = data.indexes.value(c, -1);
+            if (idx < 0)
+                return false;
+            path.append(&data.children[idx]);
+        }
+        if (path.back()->d->id != info.id())
+            return false;
+        path.back()->d->id.clear();
+
+        // Remove the nodes left empty, a full build would not create them
+        for (int i = path.size() - 1; i > 0; --i) {
+            const auto &node = *path.at(i);
+            if (!node.id().isEmpty() || !node.d->children.isEmpty())
+                break;
+
+            auto name = node.name();
+            auto &data = *path.at(i - 1)->d;
+            int idx = data.indexes.take(name);
+            data.children.removeAt(idx);
+            for (int j = idx; j < data.children.size(); ++j) {
+                data.indexes.insert(data.children.at(j).name(), j);
+            }
+        }
+        return true;
+    }
+
+    int ActionIdTable::intern(const QString &id) {
+        auto it = indexes.find(id);
+        if (it == indexes.end()) {
+            it = indexes.insert(id, ids.size());
+            ids.append(id);
+        }
+        return it.value();
+    }
+
+    void ActionLayoutsState::markDirty(int index) {
+        auto &node = heap[index];
+        if (node.dirty)
+            return;
+        node.dirty = true;
+
+        // A clean node only has clean descendants, so the ancestors of a dirty node are dirty
+        const auto parents = node.parents;
+        for (const auto &parentIdx : parents) {
+            markDirty(parentIdx);
+        }
+    }
+
+    // Binary layouts, all integers are little-endian 32-bit words
+    //
+    //   header:     magic, version, string count, string data size, extension count,
+    //               node count, child count, root count
+    //   strings:    string count + 1 offsets into the UTF-8 string data
+    //   extensions: string index of each extension hash
+    //   nodes:      id string index, type, first child and child count of each node, the
+    //               children always precede their parent
+    //   children:   node index of each child
+    //   roots:      node index of each root
+    //   string data
+    static const char BinaryLayoutsMagic[] = {'C', 'K', 'L', 'Y'};
+    static const quint32 BinaryLayoutsVersion = 1;
+    static const quint32 BinaryLayoutsHeaderWords = 8;
+    static const quint32 BinaryLayoutsNodeWords = 4;
+    static const quint32 BinaryLayoutsNoString = 0xFFFFFFFF;
+
+    static inline bool isBinaryLayouts(const QByteArray &data) {
+        return data.size() >= int(sizeof(BinaryLayoutsMagic)) &&
+               memcmp(data.constData(), BinaryLayoutsMagic, sizeof(BinaryLayoutsMagic)) == 0;
+    }
+
+    // Reads the data in place, only the strings used are decoded
+    class BinaryLayoutsReader {
+    public:
+        quint32 stringCount = 0;
+        quint32 extensionCount = 0;
+        quint32 nodeCount = 0;
+        quint32 childCount = 0;
+        quint32 rootCount = 0;
+
+        bool open(const QByteArray &data) {
+            begin = reinterpret_cast<const uchar *>(data.constData());
+            size = quint64(data.size());
+            if (!isBinaryLayouts(data) || size < BinaryLayoutsHeaderWords * 4) {
+                fprintf(stdout, "Core::ActionCatalog::restoreLayouts(): invalid format\n");
+                return false;
+            }
+            if (auto version = word(1); version != BinaryLayoutsVersion) {
+                fprintf(stdout, "Core::ActionCatalog::restoreLayouts(): unsupported version %u\n",
+                        version);
+                return false;
+            }
+
+            stringCount = word(2);
+            stringDataSize = word(3);
+            extensionCount = word(4);
+            nodeCount = word(5);
+            childCount = word(6);
+            rootCount = word(7);
+
+            stringsPos = BinaryLayoutsHeaderWords;
+            extensionsPos = stringsPos + stringCount + 1;
+            nodesPos = extensionsPos + extensionCount;
+            childrenPos = nodesPos + quint64(nodeCount) * BinaryLayoutsNodeWords;
+            rootsPos = childrenPos + childCount;
+            stringDataPos = (rootsPos + rootCount) * 4;
+            if (stringDataPos + stringDataSize != size) {
+                fprintf(stdout, "Core::ActionCatalog::restoreLayouts(): corrupted data\n");
+                return false;
+            }
+            strings.resize(int(stringCount));
+            return true;
+        }
+
+        bool string(quint32 index, QString &out) {
+            if (index == BinaryLayoutsNoString) {
+                out.clear();
+                return true;
+            }
+            if (index >= stringCount)
+                return false;
+
+            auto &s = strings[int(index)];
+            if (s.isEmpty()) {
+                auto from = word(stringsPos + index);
+                auto to = word(stringsPos + index + 1);
+                if (from > to || to > stringDataSize)
+                    return false;
+                s = QString::fromUtf8(reinterpret_cast<const char *>(begin + stringDataPos + from),
+                                      int(to - from));
+            }
+            out = s;
+            return true;
+        }
+
+        inline quint32 extension(quint32 index) const {
+            return word(extensionsPos + index);
+        }
+        inline quint32 nodeId(quint32 index) const {
+            return word(nodesPos + quint64(index) * BinaryLayoutsNodeWords);
+        }
+        inline quint32 nodeType(quint32 index) const {
+            return word(nodesPos + quint64(index) * BinaryLayoutsNodeWords + 1);
+        }
+        inline quint32 nodeFirstChild(quint32 index) const {
+            return word(nodesPos + quint64(index) * BinaryLayoutsNodeWords + 2);
+        }
+        inline quint32 nodeChildCount(quint32 index) const {
+            return word(nodesPos + quint64(index) * BinaryLayoutsNodeWords + 3);
+        }
+        inline quint32 child(quint32 index) const {
+            return word(childrenPos + index);
+        }
+        inline quint32 root(quint32 index) const {
+            return word(rootsPos + index);
+        }
+
     private:
-        struct TreeNode {
-            QString id;
-            ActionLayoutInfo::Type type = ActionLayoutInfo::Action;
-            QVector<int> children;
-
-            inline TreeNode(ActionLayoutInfo::Type type = ActionLayoutInfo::Action) : type(type) {
-            }
-
-            ActionLayout toLayout(const QVector<TreeNode> &heap,
-                                  const ActionLayout &sharedSeparator,
-                                  const ActionLayout &sharedStretch) const {
-                if (type == ActionLayoutInfo::Separator)
-                    return sharedSeparator;
-                if (type == ActionLayoutInfo::Stretch)
-                    return sharedStretch;
-                ActionLayout layout;
-                layout.setId(id);
-                layout.setType(type);
-                QList<ActionLayout> children1;
-                children1.reserve(children.size());
-                for (const auto &childIdx : children) {
-                    children1.append(
-                        heap.at(childIdx).toLayout(heap, sharedSeparator, sharedStretch));
-                }
-                layout.setChildren(children1);
-                return layout;
+        const uchar *begin = nullptr;
+        quint64 size = 0;
+        quint32 stringDataSize = 0;
+        quint64 stringsPos = 0;
+        quint64 extensionsPos = 0;
+        quint64 nodesPos = 0;
+        quint64 childrenPos = 0;
+        quint64 rootsPos = 0;
+        quint64 stringDataPos = 0;
+        QVector<QString> strings;
+
+        inline quint32 word(quint64 index) const {
+            return qFromLittleEndian<quint32>(begin + index * 4);
+        }
+    };
+
+    class BinaryLayoutsWriter {
+    public:
+        QVector<quint32> roots;
+
+        quint32 addString(const QString &s) {
+            if (s.isEmpty())
+                return BinaryLayoutsNoString;
+            auto it = stringIndexes.constFind(s);
+            if (it != stringIndexes.cend())
+                return it.value();
+
+            quint32 index = quint32(stringIndexes.size());
+            stringData += s.toUtf8();
+            stringOffsets.append(quint32(stringData.size()));
+            stringIndexes.insert(s, index);
+            return index;
+        }
+
+        quint32 addNode(const ActionLayout &layout) {
+            const auto layoutChildren = layout.children();
+            QVector<quint32> childIndexes;
+            childIndexes.reserve(layoutChildren.size());
+            for (const auto &child : layoutChildren) {
+                childIndexes.append(addNode(child));
             }
-        };
+
+            quint32 index = quint32(nodes.size()) / BinaryLayoutsNodeWords;
+            nodes.append(addString(layout.id()));
+            nodes.append(quint32(layout.type()));
+            nodes.append(quint32(children.size()));
+            nodes.append(quint32(childIndexes.size()));
+            children += childIndexes;
+            return index;
+        }
+
+        QByteArray save(const QVector<quint32> &extensions) const {
+            QVector<quint32> words;
+            words.reserve(int(BinaryLayoutsHeaderWords) + stringOffsets.size() + extensions.size() +
+                          nodes.size() + children.size() + roots.size());
+            words.append(0); // magic
+            words.append(BinaryLayoutsVersion);
+            words.append(quint32(stringIndexes.size()));
+            words.append(quint32(stringData.size()));
+            words.append(quint32(extensions.size()));
+            words.append(quint32(nodes.size()) / BinaryLayoutsNodeWords);
+            words.append(quint32(children.size()));
+            words.append(quint32(roots.size()));
+            words += stringOffsets;
+            words += extensions;
+            words += nodes;
+            words += children;
+            words += roots;
+
+            QByteArray data(words.size() * 4, Qt::Uninitialized);
+            auto p = reinterpret_cast<uchar *>(data.data());
+            for (int i = 0; i < words.size(); ++i) {
+                qToLittleEndian(words.at(i), p + i * 4);
+            }
+            memcpy(data.data(), BinaryLayoutsMagic, sizeof(BinaryLayoutsMagic));
+            data += stringData;
+            return data;
+        }
+
+    private:
+        QHash<QString, quint32> stringIndexes;
+        QByteArray stringData;
+        QVector<quint32> stringOffsets = {0};
+        QVector<quint32> nodes;
+        QVector<quint32> children;
+    };
+
+    class LayoutsHelper {
+    private:
+        using TreeNode = ActionLayoutsState::Node;
 
         const QMChronoMap<QString, const ActionExtension *> &extensions;
-        const QMChronoMap<QString, ActionObjectInfo> &objectInfoMap;
+        const ActionIdTable &objectIds;
+        const QVector<ActionObjectInfo> &objectInfos;
+
+        inline ActionObjectInfo objectInfo(int key) const {
+            return key >= 0 && key < objectInfos.size() ? objectInfos.at(key)
+                                                        : ActionObjectInfo();
+        }
+
+        bool isStandalone(int key) const {
+            auto info = objectInfo(key);
+            if (info.isNull())
+                return false;
+            return info.type() != ActionObjectInfo::Action &&
+                   info.mode() != ActionObjectInfo::Plain;
+        }
+
+        static int addNode(ActionLayoutsState &state, const TreeNode &node) {
+            int instanceIdx = state.heap.size();
+            state.heap.append(node);
+            for (const auto &childIdx : node.children) {
+                state.heap[childIdx].parents.append(instanceIdx);
+            }
+            if (node.key >= 0) {
+                if (node.key >= state.idIndexes.size())
+                    state.idIndexes.resize(node.key + 1);
+                state.idIndexes[node.key].append(instanceIdx);
+            }
+            return instanceIdx;
+        }
 
-        static int layoutInfoToLayout(const ActionLayoutInfo &layout, QVector<TreeNode> &heap,
-                                      QHash<QString, QVector<int>> &idIndexes) {
+        int layoutInfoToLayout(const ActionLayoutInfo &layout, ActionLayoutsState &state) const {
             TreeNode node;
             node.type = layout.type();
             if (node.type == ActionLayoutInfo::Separator ||
                 node.type == ActionLayoutInfo::Stretch) {
-                int instanceIdx = heap.size();
-                heap.append(node);
-                return instanceIdx;
+                return addNode(state, node);
             }
 
+            // The ids of the extensions are interned when they are added
             node.id = layout.id();
+            node.key = objectIds.indexOf(node.id);
             node.children.reserve(layout.childCount());
             for (int i = 0; i < layout.childCount(); ++i) {
-                node.children.append(layoutInfoToLayout(layout.child(i), heap, idIndexes));
+                node.children.append(layoutInfoToLayout(layout.child(i), state));
             }
-
-            int instanceIdx = heap.size();
-            heap.append(node);
-            idIndexes[node.id].append(instanceIdx);
-            return instanceIdx;
+            return addNode(state, node);
         }
 
         static QSharedPointer<QMXmlAdaptorElement> serializeLayout(const ActionLayout &layout) {
@@ -404,17 +808,20 @@ namespace Core {
                 return false;
             }
 
-            auto it = objectInfoMap.find(id);
-            if (it == objectInfoMap.end())
+            int key = objectIds.indexOf(id);
+            auto info = objectInfo(key);
+            if (info.isNull())
                 return false;
 
             if (standaloneRequired) {
-                if (it->type() == ActionObjectInfo::Action || it->mode() == ActionObjectInfo::Plain)
+                if (info.type() == ActionObjectInfo::Action ||
+                    info.mode() == ActionObjectInfo::Plain)
                     return false;
             }
 
             node.id = id;
-            switch (it->type()) {
+            node.key = key;
+            switch (info.type()) {
                 case ActionObjectInfo::Action:
                     if (e->name != QStringLiteral("action"))
                         return false;
@@ -437,8 +844,7 @@ namespace Core {
             return true;
         };
 
-        int restoreElementHelper(const QMXmlAdaptorElement *e, QVector<TreeNode> &heap,
-                                 QHash<QString, QVector<int>> &idIndexes,
+        int restoreElementHelper(const QMXmlAdaptorElement *e, ActionLayoutsState &state,
                                  bool standaloneRequired) const {
             TreeNode node;
             if (!fromNodeElement(e, node, standaloneRequired)) {
@@ -447,124 +853,454 @@ namespace Core {
 
             if (node.type == ActionLayoutInfo::Separator ||
                 node.type == ActionLayoutInfo::Stretch) {
-                int instanceIdx = heap.size();
-                heap.append(node);
-                return instanceIdx;
+                return addNode(state, node);
             }
 
             for (const auto &child : e->children) {
-                auto childIdx = restoreElementHelper(child.data(), heap, idIndexes, false);
+                auto childIdx = restoreElementHelper(child.data(), state, false);
                 if (childIdx < 0) {
                     continue;
                 }
                 node.children.append(childIdx);
             }
+            return addNode(state, node);
+        }
 
-            auto instanceIdx = heap.size();
-            heap.append(node);
-            idIndexes[node.id].append(instanceIdx);
-            return instanceIdx;
+        bool checkNode(TreeNode &node, bool standaloneRequired) const {
+            if (node.type == ActionLayoutInfo::Separator ||
+                node.type == ActionLayoutInfo::Stretch) {
+                node.id.clear();
+                node.key = -1;
+                return true;
+            }
+
+            if (node.id.isEmpty()) {
+                return false;
+            }
+
+            node.key = objectIds.indexOf(node.id);
+            auto info = objectInfo(node.key);
+            if (info.isNull())
+                return false;
+
+            if (standaloneRequired) {
+                if (info.type() == ActionObjectInfo::Action ||
+                    info.mode() == ActionObjectInfo::Plain)
+                    return false;
+            }
+
+            switch (info.type()) {
+                case ActionObjectInfo::Action:
+                    return node.type == ActionLayoutInfo::Action;
+                case ActionObjectInfo::Group:
+                    return node.type == ActionLayoutInfo::Group;
+                case ActionObjectInfo::Menu:
+                    return node.type == ActionLayoutInfo::Menu ||
+                           node.type == ActionLayoutInfo::ExpandedMenu;
+            }
+            return false;
         }
 
-    public:
-        LayoutsHelper(const QMChronoMap<QString, const ActionExtension *> &extensions,
-                      const QMChronoMap<QString, ActionObjectInfo> &objectInfoMap)
-            : extensions(extensions), objectInfoMap(objectInfoMap) {
+        // Returns -1 if the node is dropped, -2 if the data is corrupted. The writer stores a
+        // node for each occurrence, so no more nodes than stored are decoded: shared children
+        // only come from crafted data and could expand exponentially.
+        int restoreBinaryNode(BinaryLayoutsReader &reader, quint32 index, quint32 parentIndex,
+                              ActionLayoutsState &state, bool standaloneRequired,
+                              quint32 &remaining) const {
+            if (index >= reader.nodeCount || index >= parentIndex || remaining == 0)
+                return -2;
+            remaining--;
+
+            TreeNode node;
+            if (!reader.string(reader.nodeId(index), node.id))
+                return -2;
+            node.type = ActionLayoutInfo::Type(reader.nodeType(index));
+            if (!checkNode(node, standaloneRequired)) {
+                return -1;
+            }
+
+            if (node.type == ActionLayoutInfo::Separator ||
+                node.type == ActionLayoutInfo::Stretch) {
+                return addNode(state, node);
+            }
+
+            auto firstChild = reader.nodeFirstChild(index);
+            auto childCount = reader.nodeChildCount(index);
+            if (quint64(firstChild) + childCount > reader.childCount)
+                return -2;
+
+            node.children.reserve(int(childCount));
+            for (quint32 i = 0; i < childCount; ++i) {
+                auto childIdx = restoreBinaryNode(reader, reader.child(firstChild + i), index,
+                                                  state, false, remaining);
+                if (childIdx == -2)
+                    return -2;
+                if (childIdx < 0)
+                    continue;
+                node.children.append(childIdx);
+            }
+            return addNode(state, node);
         }
 
-        inline QList<ActionLayout> build() const {
-            QVector<TreeNode> heap;
-            QHash<QString, QVector<int>> idIndexes;
-            QVector<int> rootIndexes;
-            for (const auto &ext : extensions) {
-                for (int i = 0; i < ext->layoutCount(); ++i) {
-                    QList<ActionLayoutInfo> standaloneLayouts;
-
-                    // Collect standalone layouts
-                    std::list<ActionLayoutInfo> stack;
-                    stack.push_back(ext->layout(i));
-                    while (!stack.empty()) {
-                        auto layout = stack.front();
-                        stack.pop_front();
-
-                        auto it = objectInfoMap.find(layout.id());
-                        if (it == objectInfoMap.end())
-                            continue;
+        bool restoreBinary(const QByteArray &data, ActionLayoutsState &state,
+                           QSet<QString> &extensionHashSet) const {
+            BinaryLayoutsReader reader;
+            if (!reader.open(data))
+                return false;
 
-                        if (it->type() != ActionObjectInfo::Action &&
-                            it->mode() != ActionObjectInfo::Plain) {
-                            standaloneLayouts.append(layout);
+            bool corrupted = false;
+            for (quint32 i = 0; i < reader.extensionCount && !corrupted; ++i) {
+                QString hash;
+                corrupted = !reader.string(reader.extension(i), hash);
+                if (!hash.isEmpty())
+                    extensionHashSet.insert(hash);
+            }
+
+            state.heap.reserve(int(reader.nodeCount));
+            quint32 remaining = reader.nodeCount;
+            for (quint32 i = 0; i < reader.rootCount && !corrupted; ++i) {
+                int idx = restoreBinaryNode(reader, reader.root(i), reader.nodeCount, state, true,
+                                            remaining);
+                corrupted = idx == -2;
+                if (idx < 0)
+                    continue;
+                state.rootIndexes.append(idx);
+            }
+
+            if (corrupted) {
+                fprintf(stdout, "Core::ActionCatalog::restoreLayouts(): corrupted data\n");
+                return false;
+            }
+            return true;
+        }
+
+        bool restoreXml(const QByteArray &data, ActionLayoutsState &state,
+                        QSet<QString> &extensionHashSet) const {
+            QMXmlAdaptor xml;
+
+            // Read file
+            if (!xml.loadData(data)) {
+                fprintf(stdout, "Core::ActionCatalog::restoreLayouts(): invalid format\n");
+                return false;
+            }
+
+            // Check root name
+            const auto &root = xml.root;
+            if (const auto &rootName = root.name; rootName != QStringLiteral("actionDomain")) {
+                fprintf(stdout,
+                        "Core::ActionCatalog::restoreLayouts(): unknown root element tag "
+                        "\"%s\"\n",
+                        rootName.toLatin1().data());
+                return false;
+            }
+
+            for (const auto &rootChild : root.children) {
+                if (rootChild->name == QStringLiteral("extensions")) {
+                    for (const auto &extensionsChild : rootChild->children) {
+                        auto hash = extensionsChild->properties.value(QStringLiteral("hash"));
+                        if (!hash.isEmpty())
+                            extensionHashSet.insert(hash);
+                    }
+                    continue;
+                }
+
+                if (rootChild->name == QStringLiteral("layouts")) {
+                    for (const auto &item : rootChild->children) {
+                        int idx = restoreElementHelper(item.data(), state, true);
+                        if (idx < 0)
                             continue;
-                        }
+                        state.rootIndexes.append(idx);
+                    }
+                }
+            }
+            return true;
+        }
 
-                        for (int j = 0; j < layout.childCount(); ++j) {
-                            stack.push_back(layout.child(j));
-                        }
+        void addStandaloneLayouts(const ActionExtension *ext, ActionLayoutsState &state) const {
+            for (int i = 0; i < ext->layoutCount(); ++i) {
+                QList<ActionLayoutInfo> standaloneLayouts;
+
+                // Collect standalone layouts
+                std::list<ActionLayoutInfo> stack;
+                stack.push_back(ext->layout(i));
+                while (!stack.empty()) {
+                    auto layout = stack.front();
+                    stack.pop_front();
+
+                    auto info = objectInfo(objectIds.indexOf(layout.id()));
+                    if (info.isNull())
+                        continue;
+
+                    if (info.type() != ActionObjectInfo::Action &&
+                        info.mode() != ActionObjectInfo::Plain) {
+                        standaloneLayouts.append(layout);
+                        continue;
                     }
-                    for (const auto &layout : std::as_const(standaloneLayouts)) {
-                        rootIndexes.append(layoutInfoToLayout(layout, heap, idIndexes));
+
+                    for (int j = 0; j < layout.childCount(); ++j) {
+                        stack.push_back(layout.child(j));
                     }
                 }
+                for (const auto &layout : std::as_const(standaloneLayouts)) {
+                    state.rootIndexes.append(layoutInfoToLayout(layout, state));
+                }
             }
-            return applyBuildRoutines(extensions.values_qlist(), heap, idIndexes, rootIndexes);
         }
 
-        inline QList<ActionLayout> restore(const QByteArray &data, bool *ok) const {
-            QVector<TreeNode> heap;
-            QHash<QString, QVector<int>> idIndexes;
-            QVector<int> rootIndexes;
-            QSet<QString> extensionHashSet;
+        // Only the parents from minParentIndex on are affected, the original children of the
+        // modified nodes below the undo record's heap size are saved to it
+        void applyBuildRoutine(const ActionBuildRoutine &routine, ActionLayoutsState &state,
+                               int minParentIndex = 0,
+                               ActionLayoutsState::Undo *undo = nullptr) const {
+            int parentKey = objectIds.indexOf(routine.parent());
+            if (parentKey < 0 || parentKey >= state.idIndexes.size() ||
+                state.idIndexes.at(parentKey).isEmpty())
+                return;
 
-            *ok = false;
-            {
-                QMXmlAdaptor xml;
+            const auto &instances = state.idIndexes.at(parentKey);
+            QVector<int> parentIndexes =
+                isStandalone(parentKey) ? QVector<int>{instances.first()} : instances;
+            if (minParentIndex > 0) {
+                parentIndexes.erase(std::remove_if(parentIndexes.begin(), parentIndexes.end(),
+                                                   [minParentIndex](int idx) {
+                                                       return idx < minParentIndex; //
+                                                   }),
+                                    parentIndexes.end());
+                if (parentIndexes.isEmpty())
+                    return;
+            }
+
+            // An empty anchor matches the separators and stretches like their empty ids do
+            auto relativeTo = routine.relativeTo();
+            int relativeKey = relativeTo.isEmpty() ? -1 : objectIds.indexOf(relativeTo);
+            if (relativeKey < 0 && !relativeTo.isEmpty())
+                relativeKey = -2;
+
+            QVector<int> layoutsToInsert;
+            layoutsToInsert.reserve(routine.itemCount());
+            for (int j = 0; j < routine.itemCount(); ++j) {
+                layoutsToInsert.append(layoutInfoToLayout(routine.item(j), state));
+            }
 
-                // Read file
-                if (!xml.loadData(data)) {
-                    fprintf(stdout, "Core::ActionCatalog::restoreLayouts(): invalid format\n");
-                    return {};
+            for (const auto &parentIdx : std::as_const(parentIndexes)) {
+                const auto &children = state.heap.at(parentIdx).children;
+                int pos = -1;
+                switch (routine.anchor()) {
+                    case ActionBuildRoutine::Last: {
+                        pos = children.size();
+                        break;
+                    }
+                    case ActionBuildRoutine::First: {
+                        pos = 0;
+                        break;
+                    }
+                    case ActionBuildRoutine::After: {
+                        for (int j = 0; j < children.size(); ++j) {
+                            if (state.heap.at(children[j]).key == relativeKey) {
+                                pos = j + 1;
+                                break;
+                            }
+                        }
+                        break;
+                    }
+                    case ActionBuildRoutine::Before: {
+                        for (int j = 0; j < children.size(); ++j) {
+                            if (state.heap.at(children[j]).key == relativeKey) {
+                                pos = j;
+                                break;
+                            }
+                        }
+                        break;
+                    }
                 }
+                if (pos < 0)
+                    continue;
 
-                // Check root name
-                const auto &root = xml.root;
-                if (const auto &rootName = root.name; rootName != QStringLiteral("actionDomain")) {
-                    fprintf(stdout,
-                            "Core::ActionCatalog::restoreLayouts(): unknown root element tag "
-                            "\"%s\"\n",
-                            rootName.toLatin1().data());
-                    return {};
+                if (undo && parentIdx < undo->heapSize && !undo->children.contains(parentIdx)) {
+                    undo->children.insert(parentIdx, children);
                 }
 
-                for (const auto &rootChild : root.children) {
-                    if (rootChild->name == QStringLiteral("extensions")) {
-                        for (const auto &extensionsChild : rootChild->children) {
-                            auto hash = extensionsChild->properties.value(QStringLiteral("hash"));
-                            if (!hash.isEmpty())
-                                extensionHashSet.insert(hash);
-                        }
+                auto &parentLayout = state.heap[parentIdx];
+                parentLayout.children.insert(pos, layoutsToInsert.size(), 0);
+                for (int k = 0; k < layoutsToInsert.size(); ++k) {
+                    parentLayout.children[pos + k] = layoutsToInsert[k];
+                    state.heap[layoutsToInsert[k]].parents.append(parentIdx);
+                }
+                state.markDirty(parentIdx);
+            }
+        }
+
+        void updateNode(ActionLayoutsState &state, int index) const {
+            if (!state.heap.at(index).dirty)
+                return;
+
+            const auto node = state.heap.at(index);
+            ActionLayout layout;
+            layout.setType(node.type);
+
+            // Standalone menus referred by the subtree, see setLayouts_helper()
+            QVector<int> menuReferences;
+            if (node.type != ActionLayoutInfo::Separator &&
+                node.type != ActionLayoutInfo::Stretch) {
+                layout.setId(node.id);
+
+                QList<ActionLayout> children1;
+                children1.reserve(node.children.size());
+                for (const auto &childIdx : node.children) {
+                    updateNode(state, childIdx);
+
+                    const auto &child = state.heap.at(childIdx);
+                    children1.append(child.layout);
+                    auto info = objectInfo(child.key);
+                    if (info.isNull())
                         continue;
+                    if (info.type() == ActionObjectInfo::Menu &&
+                        info.mode() != ActionObjectInfo::Plain) {
+                        menuReferences.append(child.key);
                     }
+                    menuReferences += child.menuReferences;
+                }
+                std::sort(menuReferences.begin(), menuReferences.end());
+                menuReferences.erase(std::unique(menuReferences.begin(), menuReferences.end()),
+                                     menuReferences.end());
+                layout.setChildren(children1);
+            }
 
-                    if (rootChild->name == QStringLiteral("layouts")) {
-                        for (const auto &item : rootChild->children) {
-                            int idx = restoreElementHelper(item.data(), heap, idIndexes, true);
-                            if (idx < 0)
-                                continue;
-                            rootIndexes.append(idx);
-                        }
-                    }
+            auto &node1 = state.heap[index];
+            node1.layout = layout;
+            node1.menuReferences = menuReferences;
+            node1.dirty = false;
+        }
+
+    public:
+        LayoutsHelper(const QMChronoMap<QString, const ActionExtension *> &extensions,
+                      const ActionIdTable &objectIds,
+                      const QVector<ActionObjectInfo> &objectInfos)
+            : extensions(extensions), objectIds(objectIds), objectInfos(objectInfos) {
+        }
+
+        inline ActionLayoutsState build() const {
+            ActionLayoutsState state;
+            for (const auto &ext : extensions) {
+                addStandaloneLayouts(ext, state);
+            }
+            for (const auto &ext : extensions) {
+                for (int i = 0; i < ext->buildRoutineCount(); ++i) {
+                    applyBuildRoutine(ext->buildRoutine(i), state);
+                }
+            }
+            return state;
+        }
+
+        // Applies the last registered extension to a state built from the former ones, returns
+        // false if the result could differ from a full build
+        bool applyExtension(ActionLayoutsState &state, const ActionExtension *extension) const {
+            const int heapSize = state.heap.size();
+            const int rootCount = state.rootIndexes.size();
+
+            // In a full build the new roots are created before any routine is applied, so the
+            // former routines have to be replayed on the new nodes
+            addStandaloneLayouts(extension, state);
+            const int rootsEnd = state.heap.size();
+            for (const auto &ext : extensions) {
+                if (ext == extension)
+                    break;
+                for (int i = 0; i < ext->buildRoutineCount(); ++i) {
+                    applyBuildRoutine(ext->buildRoutine(i), state, heapSize);
                 }
             }
+
+            // The first instance of a standalone node is where routines apply, it must be the
+            // same as in a full build
+            for (int i = heapSize; i < state.heap.size(); ++i) {
+                int key = state.heap.at(i).key;
+                if (!isStandalone(key))
+                    continue;
+                if (i >= rootsEnd || state.idIndexes.at(key).first() < heapSize)
+                    return false;
+            }
+
+            ActionLayoutsState::Undo undo;
+            undo.hash = extension->hash();
+            undo.heapSize = heapSize;
+            undo.rootCount = rootCount;
+            for (int i = 0; i < extension->buildRoutineCount(); ++i) {
+                applyBuildRoutine(extension->buildRoutine(i), state, 0, &undo);
+            }
+            state.undo = undo;
+            return true;
+        }
+
+        static void rollback(ActionLayoutsState &state) {
+            const auto undo = state.undo.value();
+            state.undo.reset();
+
+            for (auto it = undo.children.begin(); it != undo.children.end(); ++it) {
+                state.heap[it.key()].children = it.value();
+                state.markDirty(it.key());
+            }
+            state.heap.resize(undo.heapSize);
+            state.rootIndexes.resize(undo.rootCount);
+            for (auto &indexes : state.idIndexes) {
+                while (!indexes.isEmpty() && indexes.last() >= undo.heapSize) {
+                    indexes.removeLast();
+                }
+            }
+        }
+
+        QList<ActionLayout> convert(ActionLayoutsState &state,
+                                    QList<QVector<int>> *menuReferences = nullptr) const {
+            QList<ActionLayout> result;
+            result.reserve(state.rootIndexes.size());
+            for (const auto &rootIndex : std::as_const(state.rootIndexes)) {
+                updateNode(state, rootIndex);
+
+                const auto &node = state.heap.at(rootIndex);
+                result.append(node.layout);
+                if (menuReferences)
+                    menuReferences->append(node.menuReferences);
+            }
+            return result;
+        }
+
+        inline QList<ActionLayout> restore(const QByteArray &data, bool *ok) const {
+            ActionLayoutsState state;
+            QSet<QString> extensionHashSet;
+
+            *ok = false;
+            if (!(isBinaryLayouts(data) ? restoreBinary(data, state, extensionHashSet)
+                                        : restoreXml(data, state, extensionHashSet))) {
+                return {};
+            }
             *ok = true;
 
-            QList<const ActionExtension *> effectiveExtensions;
+            // Apply build routines of the extensions unknown to the data
             for (const auto &ext : extensions) {
                 if (extensionHashSet.contains(ext->hash()))
                     continue;
-                effectiveExtensions.append(ext);
+                for (int i = 0; i < ext->buildRoutineCount(); ++i) {
+                    applyBuildRoutine(ext->buildRoutine(i), state);
+                }
             }
+            return convert(state);
+        }
+
+        static inline QByteArray
+            serializeBinary(const QMChronoMap<QString, const ActionExtension *> &extensions,
+                            const QList<ActionLayout> &layouts) {
+            BinaryLayoutsWriter writer;
 
-            return applyBuildRoutines(effectiveExtensions, heap, idIndexes, rootIndexes);
+            QVector<quint32> extensionIndexes;
+            extensionIndexes.reserve(extensions.size());
+            for (const auto &item : extensions) {
+                extensionIndexes.append(writer.addString(item->hash()));
+            }
+
+            writer.roots.reserve(layouts.size());
+            for (const auto &item : layouts) {
+                writer.roots.append(writer.addNode(item));
+            }
+            return writer.save(extensionIndexes);
         }
 
         static inline QByteArray
@@ -595,95 +1331,357 @@ namespace Core {
             root.children.append({extensionsElement, layoutsElement});
             return xml.saveData();
         }
+    };
 
-    private:
-        QList<ActionLayout>
-            applyBuildRoutines(const QList<const ActionExtension *> &effectiveExtensions,
-                               QVector<TreeNode> &heap, QHash<QString, QVector<int>> &idIndexes,
-                               const QVector<int> &rootIndexes) const {
-            // Apply build routines
-            for (const auto &ext : effectiveExtensions) {
-                for (int i = 0; i < ext->buildRoutineCount(); ++i) {
-                    auto routine = ext->buildRoutine(i);
-                    auto it = idIndexes.find(routine.parent());
-                    if (it == idIndexes.end())
-                        continue;
+    void ActionDomainPrivate::flushLayouts() const {
+        if (layouts)
+            return;
 
+        LayoutsHelper helper(extensions, objectIds, objectInfos);
+        if (!layoutsState) {
+            layoutsState = helper.build();
+        }
 
-                    QVector<int> layoutsToInsert;
-                    layoutsToInsert.reserve(routine.itemCount());
-                    for (int j = 0; j < routine.itemCount(); ++j) {
-                        auto idx = layoutInfoToLayout(routine.item(j), heap, idIndexes);
-                        layoutsToInsert.append(idx);
-                    }
+        // Only the nodes changed since the last flush are converted again
+        QList<QVector<int>> menuReferences;
+        auto result = helper.convert(layoutsState.value(), &menuReferences);
+        if (!setLayouts_helper(result, &menuReferences)) {
+            layouts = QList<ActionLayout>();
+            layoutPlan.reset();
+        }
+    }
 
-                    auto info = objectInfoMap.value(routine.parent());
-                    const QVector<int> &parentIndexes =
-                        (!info.isNull() && info.type() != ActionObjectInfo::Action &&
-                         info.mode() != ActionObjectInfo::Plain)
-                            ? QVector<int>{it->first()}
-                            : it.value();
-                    for (const auto &parentIdx : std::as_const(parentIndexes)) {
-                        auto &parentLayout = heap[parentIdx];
-                        switch (routine.anchor()) {
-                            case ActionBuildRoutine::Last: {
-                                parentLayout.children += layoutsToInsert;
-                                break;
-                            }
-                            case ActionBuildRoutine::First: {
-                                parentLayout.children = layoutsToInsert + parentLayout.children;
-                                break;
-                            }
-                            case ActionBuildRoutine::After: {
-                                for (int j = 0; j < parentLayout.children.size(); ++j) {
-                                    if (heap[parentLayout.children[j]].id == routine.relativeTo()) {
-                                        parentLayout.children.insert(j + 1, layoutsToInsert.size(),
-                                                                     0);
-                                        for (int k = 0; k < layoutsToInsert.size(); ++k) {
-                                            parentLayout.children[j + 1 + k] = layoutsToInsert[k];
-                                        }
-                                        break;
-                                    }
-                                }
-                                break;
-                            }
-                            case ActionBuildRoutine::Before: {
-                                for (int j = 0; j < parentLayout.children.size(); ++j) {
-                                    if (heap[parentLayout.children[j]].id == routine.relativeTo()) {
-                                        parentLayout.children.insert(j, layoutsToInsert.size(), 0);
-                                        for (int k = 0; k < layoutsToInsert.size(); ++k) {
-                                            parentLayout.children[j + k] = layoutsToInsert[k];
-                                        }
-                                        break;
-                                    }
-                                }
-                                break;
-                            }
-                        }
-                    }
-                }
+    void ActionDomainPrivate::setObjectInfo(const QString &id, const ActionObjectInfo &info) {
+        int key = objectIds.intern(id);
+        if (key >= objectInfos.size())
+            objectInfos.resize(objectIds.size());
+        objectInfos[key] = info;
+    }
+
+    // The referred ids are interned as well, so that the layouts only look up the interned ones
+    void ActionDomainPrivate::changeLayoutReferences(const ActionExtension *extension,
+                                                     int delta) {
+        auto change = [this, delta](const QString &id) {
+            if (id.isEmpty())
+                return;
+            if (delta > 0)
+                objectIds.intern(id);
+            auto &count = layoutReferences[id];
+            count += delta;
+            if (count <= 0)
+                layoutReferences.remove(id);
+        };
+
+        std::list<ActionLayoutInfo> stack;
+        for (int i = 0; i < extension->layoutCount(); ++i) {
+            stack.push_back(extension->layout(i));
+        }
+        for (int i = 0; i < extension->buildRoutineCount(); ++i) {
+            auto routine = extension->buildRoutine(i);
+            change(routine.parent());
+            if (auto relativeTo = routine.relativeTo(); delta > 0 && !relativeTo.isEmpty())
+                objectIds.intern(relativeTo);
+            for (int j = 0; j < routine.itemCount(); ++j) {
+                stack.push_back(routine.item(j));
+            }
+        }
+        while (!stack.empty()) {
+            auto layout = stack.front();
+            stack.pop_front();
+            change(layout.id());
+            for (int j = 0; j < layout.childCount(); ++j) {
+                stack.push_back(layout.child(j));
             }
+        }
+    }
 
-            // Convert to layout
-            ActionLayout sharedSeparator;
-            sharedSeparator.setType(ActionLayoutInfo::Separator);
-            ActionLayout sharedStretch;
-            sharedStretch.setType(ActionLayoutInfo::Stretch);
+    // Icon bundles, all integers are little-endian 32-bit words
+    //
+    //   header:    magic, version, entry count, string data size, blob data size,
+    //              theme offset, theme length
+    //   entries:   id offset, id length, format offset, format length, blob offset, blob size
+    //   string data, UTF-8 strings addressed by byte offset and length
+    //   blob data, the image files as they are on disk
+    static const char IconBundleMagic[] = {'C', 'K', 'I', 'B'};
+    static const quint32 IconBundleVersion = 1;
+    static const quint32 IconBundleHeaderWords = 7;
+    static const quint32 IconBundleEntryWords = 6;
+
+    // The storage refers to a bundled icon as "ckib:<bundle file>#<entry index>"
+    static const QLatin1String IconBundleScheme("ckib:");
+
+    static inline QString iconBundleReference(const QString &fileName, int index) {
+        return IconBundleScheme + fileName + QLatin1Char('#') + QString::number(index);
+    }
 
-            QList<ActionLayout> result;
-            for (const auto &rootIndex : rootIndexes) {
-                result.append(heap.at(rootIndex).toLayout(heap, sharedSeparator, sharedStretch));
+    ActionIconBundle::~ActionIconBundle() {
+        if (mapped)
+            file.unmap(mapped);
+    }
+
+    bool ActionIconBundle::open(const QString &fileName) {
+        // Tells the pixmaps of a mapping from the ones of a previous mapping of the same file
+        static QAtomicInteger<quint64> serials;
+        serial = ++serials;
+
+        file.setFileName(fileName);
+        if (!file.open(QIODevice::ReadOnly)) {
+            fprintf(stdout, "Core::ActionDomain: %s: failed to read icon bundle\n",
+                    qPrintable(fileName));
+            return false;
+        }
+
+        auto size = quint64(file.size());
+        if (size < IconBundleHeaderWords * 4 || !(mapped = file.map(0, qint64(size))) ||
+            memcmp(mapped, IconBundleMagic, sizeof(IconBundleMagic)) != 0) {
+            fprintf(stdout, "Core::ActionDomain: %s: invalid icon bundle\n", qPrintable(fileName));
+            return false;
+        }
+
+        auto word = [this](quint64 index) {
+            return qFromLittleEndian<quint32>(mapped + index * 4); //
+        };
+        if (auto version = word(1); version != IconBundleVersion) {
+            fprintf(stdout, "Core::ActionDomain: %s: unsupported icon bundle version %u\n",
+                    qPrintable(fileName), version);
+            return false;
+        }
+
+        auto entryCount = word(2);
+        auto stringDataSize = word(3);
+        auto blobDataSize = word(4);
+        auto stringDataPos = (IconBundleHeaderWords + quint64(entryCount) * IconBundleEntryWords) * 4;
+        auto blobDataPos = stringDataPos + stringDataSize;
+        if (blobDataPos + blobDataSize != size) {
+            fprintf(stdout, "Core::ActionDomain: %s: corrupted icon bundle\n", qPrintable(fileName));
+            return false;
+        }
+
+        auto string = [&](quint64 pos, QByteArray &out) {
+            auto offset = word(pos);
+            auto length = word(pos + 1);
+            if (quint64(offset) + length > stringDataSize)
+                return false;
+            out = QByteArray::fromRawData(
+                reinterpret_cast<const char *>(mapped + stringDataPos + offset), int(length));
+            return true;
+        };
+
+        QByteArray themeData;
+        if (!string(5, themeData)) {
+            fprintf(stdout, "Core::ActionDomain: %s: corrupted icon bundle\n", qPrintable(fileName));
+            return false;
+        }
+        theme = QString::fromUtf8(themeData);
+
+        entries.reserve(int(entryCount));
+        for (quint32 i = 0; i < entryCount; ++i) {
+            auto pos = IconBundleHeaderWords + quint64(i) * IconBundleEntryWords;
+            QByteArray id;
+            Entry entry;
+            auto offset = word(pos + 4);
+            auto length = word(pos + 5);
+            if (!string(pos, id) || !string(pos + 2, entry.format) ||
+                quint64(offset) + length > blobDataSize) {
+                fprintf(stdout, "Core::ActionDomain: %s: corrupted icon bundle\n",
+                        qPrintable(fileName));
+                entries.clear();
+                return false;
             }
-            return result;
+            entry.id = QString::fromUtf8(id);
+            entry.data = QByteArray::fromRawData(
+                reinterpret_cast<const char *>(mapped + blobDataPos + offset), int(length));
+            entries.append(entry);
+        }
+        return true;
+    }
+
+    // Decodes a bundled icon at the sizes asked for, the bundle stays mapped while it is alive
+    class ActionIconBundleEngine : public QIconEngine {
+    public:
+        ActionIconBundleEngine(const QSharedPointer<const ActionIconBundle> &bundle, int index)
+            : bundle(bundle), index(index), entry(bundle->entries.at(index)) {
+        }
+
+        void paint(QPainter *painter, const QRect &rect, QIcon::Mode mode,
+                   QIcon::State state) override {
+            auto ratio = painter->device()->devicePixelRatioF();
+            auto pm = pixmap(rect.size() * ratio, mode, state);
+            painter->drawPixmap(rect, pm);
+        }
+
+        QSize actualSize(const QSize &size, QIcon::Mode mode, QIcon::State state) override {
+            Q_UNUSED(mode);
+            Q_UNUSED(state);
+            auto imageSize = sourceSize();
+            if (scalable() || !imageSize.isValid())
+                return size;
+            if (imageSize.width() <= size.width() && imageSize.height() <= size.height())
+                return imageSize;
+            return imageSize.scaled(size, Qt::KeepAspectRatio);
+        }
+
+        QPixmap pixmap(const QSize &size, QIcon::Mode mode, QIcon::State state) override {
+            auto key = QStringLiteral("ckib_%1_%2_%3_%4_%5")
+                           .arg(bundle->serial)
+                           .arg(index)
+                           .arg(size.width())
+                           .arg(size.height())
+                           .arg(int(mode));
+            QPixmap pm;
+            if (QPixmapCache::find(key, &pm))
+                return pm;
+
+            QBuffer buffer;
+            buffer.setData(entry.data);
+            buffer.open(QIODevice::ReadOnly);
+            QImageReader reader(&buffer, entry.format);
+            if (auto imageSize = actualSize(size, mode, state); imageSize != reader.size())
+                reader.setScaledSize(imageSize);
+            pm = QPixmap::fromImage(reader.read());
+            if (pm.isNull())
+                return pm;
+
+            if (mode != QIcon::Normal) {
+                QStyleOption opt(0);
+                opt.palette = QGuiApplication::palette();
+                pm = QApplication::style()->generatedIconPixmap(mode, pm, &opt);
+            }
+            QPixmapCache::insert(key, pm);
+            return pm;
+        }
+
+        QString key() const override {
+            return QStringLiteral("ActionIconBundleEngine");
+        }
+
+        QIconEngine *clone() const override {
+            return new ActionIconBundleEngine(*this);
+        }
+
+    private:
+        QSharedPointer<const ActionIconBundle> bundle;
+        int index;
+        ActionIconBundle::Entry entry;
+        std::optional<QSize> cachedSourceSize;
+
+        bool scalable() const {
+            return entry.format == "svg" || entry.format == "svgz";
+        }
+
+        QSize sourceSize() {
+            if (!cachedSourceSize) {
+                QBuffer buffer;
+                buffer.setData(entry.data);
+                buffer.open(QIODevice::ReadOnly);
+                cachedSourceSize = QImageReader(&buffer, entry.format).size();
+            }
+            return cachedSourceSize.value();
         }
     };
 
-    void ActionDomainPrivate::flushLayouts() const {
-        if (layouts)
-            return;
-        if (!setLayouts_helper(LayoutsHelper(extensions, objectInfoMap).build())) {
-            layouts = QList<ActionLayout>();
+    QIcon ActionDomainPrivate::bundledIcon(const QString &reference) const {
+        auto sep = reference.lastIndexOf(QLatin1Char('#'));
+        auto fileName = reference.mid(IconBundleScheme.size(), sep - IconBundleScheme.size());
+        auto bundle = iconBundles.value(fileName);
+        bool ok;
+        int index = reference.midRef(sep + 1).toInt(&ok);
+        if (!bundle || !ok || index < 0 || index >= bundle->entries.size())
+            return {};
+        return QIcon(new ActionIconBundleEngine(bundle, index));
+    }
+
+    QIcon ActionDomainPrivate::cachedIcon(const QString &fileName) const {
+        if (fileName.isEmpty())
+            return {};
+
+        auto it = iconCache.find(fileName);
+        if (it == iconCache.end()) {
+            if (fileName.startsWith(IconBundleScheme))
+                return *iconCache.insert(fileName, bundledIcon(fileName));
+
+            // The file is used as is until its pixmaps are ready
+            it = iconCache.insert(fileName, QIcon(fileName));
+            if (!iconCacheDirectory.isEmpty())
+                rasterizeIcon(fileName);
         }
+        return it.value();
+    }
+
+    // Runs in the thread pool, returns the pixmap files with their sizes or nothing on failure
+    static QVector<QPair<QString, int>> rasterizeIconFile(const QString &fileName,
+                                                          const QString &cacheDirectory,
+                                                          const QList<qreal> &ratios) {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+            return {};
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        if (!hash.addData(&file))
+            return {};
+
+        // <cache>/<file hash>/<pixel size>.png
+        QDir dir(cacheDirectory + QLatin1Char('/') + QString::fromLatin1(hash.result().toHex()));
+        if (!dir.exists() && !dir.mkpath(QStringLiteral(".")))
+            return {};
+
+        static const int sizes[] = {16, 20, 24, 32, 48};
+        QVector<QPair<QString, int>> res;
+        for (const auto &ratio : ratios) {
+            for (const auto &size : sizes) {
+                int pixelSize = qRound(size * ratio);
+                auto pixmapFile = dir.filePath(QStringLiteral("%1.png").arg(pixelSize));
+                if (!QFileInfo::exists(pixmapFile)) {
+                    // Images can be rendered outside of the GUI thread, unlike pixmaps, and the
+                    // file only appears once complete in case another process reads it
+                    QImageReader reader(fileName);
+                    reader.setScaledSize(QSize(pixelSize, pixelSize));
+                    auto image = reader.read();
+                    QSaveFile out(pixmapFile);
+                    if (image.isNull() || !out.open(QIODevice::WriteOnly) ||
+                        !image.save(&out, "PNG") || !out.commit())
+                        return {};
+                }
+                res.append({pixmapFile, pixelSize});
+            }
+        }
+        return res;
+    }
+
+    void ActionDomainPrivate::rasterizeIcon(const QString &fileName) const {
+        // Only vector images are worth rasterizing
+        auto suffix = QFileInfo(fileName).suffix().toLower();
+        if (suffix != QStringLiteral("svg") && suffix != QStringLiteral("svgz"))
+            return;
+
+        QList<qreal> ratios = {1.0};
+        if (qGuiApp && !qFuzzyCompare(qGuiApp->devicePixelRatio(), 1.0))
+            ratios.append(qGuiApp->devicePixelRatio());
+
+        // The watcher goes with the domain, the result is dropped if the cache has been cleared
+        // or the entry replaced meanwhile
+        auto watcher = new QFutureWatcher<QVector<QPair<QString, int>>>(q_ptr);
+        const auto directory = iconCacheDirectory;
+        QObject::connect(watcher, &QFutureWatcherBase::finished, q_ptr,
+                         [this, watcher, fileName, directory]() {
+                             watcher->deleteLater();
+                             const auto files = watcher->result();
+                             if (files.isEmpty() || directory != iconCacheDirectory)
+                                 return;
+                             auto it = iconCache.find(fileName);
+                             if (it == iconCache.end())
+                                 return;
+                             QIcon icon;
+                             for (const auto &item : files) {
+                                 icon.addFile(item.first, QSize(item.second, item.second));
+                             }
+                             it.value() = icon;
+                         });
+        watcher->setFuture(QtConcurrent::run(rasterizeIconFile, fileName, directory, ratios));
+    }
+
+    static QHash<QString, QHash<QString, QString>>
+        parseIconConfiguration(const QString &fileName) {
+        return IconConfigParser{fileName, {}}.parse();
     }
 
     void ActionDomainPrivate::flushIcons() const {
@@ -691,11 +1689,30 @@ namespace Core {
         if (changes.isEmpty())
             return;
 
+        auto &storage = iconStorage.storage;
+        auto &indexes = iconStorage.items;
+
+        // Icons whose provider may have changed, and the items moved to the back
+        QSet<QPair<QString, QString>> affected;
+        QList<QStringList> appended;
+        auto markAffected = [&](const QStringList &keys) {
+            if (keys.size() == 1) {
+                const auto &configMap = iconStorage.configFiles[keys[0]];
+                for (auto it = configMap.begin(); it != configMap.end(); ++it) {
+                    for (auto it2 = it->begin(); it2 != it->end(); ++it2) {
+                        affected.insert({it.key(), it2.key()});
+                    }
+                }
+            } else {
+                affected.insert({keys[0], keys[1]});
+            }
+        };
+
         for (const auto &c : std::as_const(changes)) {
             if (c.index() == 0) {
                 auto &map = iconStorage.singles;
-                auto &indexes = iconStorage.items;
                 auto itemToBeChanged = std::get<0>(c);
+                QStringList keys = {itemToBeChanged.theme, itemToBeChanged.id};
                 if (itemToBeChanged.remove) {
                     auto it = map.find(itemToBeChanged.theme);
                     if (it != map.end()) {
@@ -704,68 +1721,202 @@ namespace Core {
                             if (map0.isEmpty()) {
                                 map.erase(it);
                             }
-                            indexes.remove({itemToBeChanged.theme, itemToBeChanged.id});
+                            indexes.remove(keys);
+                            markAffected(keys);
                         }
                     }
                 } else if (auto info = QFileInfo(itemToBeChanged.fileName); info.isFile()) {
-                    QStringList keys = {itemToBeChanged.theme, itemToBeChanged.id};
+                    if (indexes.contains(keys))
+                        markAffected(keys);
                     map[itemToBeChanged.theme][itemToBeChanged.id] = info.canonicalFilePath();
                     indexes.remove(keys);
                     indexes.append(keys);
+                    appended.append(keys);
                 }
             } else {
                 auto &map = iconStorage.configFiles;
-                auto &indexes = iconStorage.items;
                 auto itemToBeChanged = std::get<1>(c);
+                QStringList keys = {itemToBeChanged.fileName};
                 if (itemToBeChanged.remove) {
-                    if (map.remove(itemToBeChanged.fileName)) {
-                        indexes.remove({itemToBeChanged.fileName});
+                    if (map.contains(itemToBeChanged.fileName)) {
+                        markAffected(keys);
+                        map.remove(itemToBeChanged.fileName);
+                        indexes.remove(keys);
                     }
-                } else if (auto iconsFromFile =
-                               IconConfigParser{itemToBeChanged.fileName, {}}.parse();
-                           !iconsFromFile.isEmpty()) {
-                    QStringList keys = {itemToBeChanged.fileName};
-                    map[itemToBeChanged.fileName] = {};
-                    indexes.remove(keys);
-                    indexes.append(keys);
+                    continue;
                 }
+
+                // Use the cached result if the file is unchanged since it was parsed
+                QHash<QString, QHash<QString, QString>> iconsFromFile;
+                auto it = iconConfigCache.find(itemToBeChanged.fileName);
+                if (it != iconConfigCache.end() &&
+                    it->lastModified == itemToBeChanged.lastModified &&
+                    it->size == itemToBeChanged.size) {
+                    iconsFromFile = it->icons;
+                } else {
+                    iconsFromFile = itemToBeChanged.future.isStarted()
+                                        ? itemToBeChanged.future.result()
+                                        : parseIconConfiguration(itemToBeChanged.fileName);
+                    iconConfigCache.insert(itemToBeChanged.fileName,
+                                           {itemToBeChanged.lastModified, itemToBeChanged.size,
+                                            iconsFromFile});
+                }
+                if (iconsFromFile.isEmpty())
+                    continue;
+
+                if (indexes.contains(keys))
+                    markAffected(keys);
+                map[itemToBeChanged.fileName] = iconsFromFile;
+                indexes.remove(keys);
+                indexes.append(keys);
+                appended.append(keys);
             }
         }
-        changes.clear();
+        changes.clear();
+
+        // Files of the replaced items may have changed on disk
+        for (const auto &keys : std::as_const(appended)) {
+            if (keys.size() == 1) {
+                const auto &configMap = iconStorage.configFiles[keys[0]];
+                for (const auto &themeMap : configMap) {
+                    for (const auto &fileName : themeMap) {
+                        iconCache.remove(fileName);
+                    }
+                }
+            } else {
+                iconCache.remove(iconStorage.singles[keys[0]][keys[1]]);
+            }
+        }
+
+        // The items at the back take precedence, apply the new ones
+        for (const auto &keys : std::as_const(appended)) {
+            if (keys.size() == 1) {
+                const auto &configMap = iconStorage.configFiles[keys[0]];
+                for (auto it = configMap.begin(); it != configMap.end(); ++it) {
+                    auto &to = storage[it.key()];
+                    for (auto it2 = it->begin(); it2 != it->end(); ++it2) {
+                        to.insert(it2.key(), it2.value());
+                    }
+                }
+            } else {
+                storage[keys[0]][keys[1]] = iconStorage.singles[keys[0]][keys[1]];
+            }
+        }
+        if (affected.isEmpty())
+            return;
+
+        // Find the last provider of the icons that were removed or replaced
+        QList<QStringList> order;
+        for (const auto &keys : std::as_const(indexes)) {
+            order.append(keys);
+        }
+        for (const auto &pair : std::as_const(affected)) {
+            const auto &theme = pair.first;
+            const auto &id = pair.second;
+            iconCache.remove(storage.value(theme).value(id));
+
+            std::optional<QString> fileName;
+            for (int i = order.size() - 1; i >= 0 && !fileName; --i) {
+                const auto &keys = order.at(i);
+                if (keys.size() == 1) {
+                    const auto &configMap = iconStorage.configFiles[keys[0]];
+                    auto it = configMap.find(theme);
+                    if (it == configMap.end())
+                        continue;
+                    auto it2 = it->find(id);
+                    if (it2 != it->end())
+                        fileName = it2.value();
+                } else if (keys[0] == theme && keys[1] == id) {
+                    fileName = iconStorage.singles[theme][id];
+                }
+            }
+
+            if (fileName) {
+                storage[theme][id] = fileName.value();
+                continue;
+            }
+            auto it = storage.find(theme);
+            if (it == storage.end())
+                continue;
+            it->remove(id);
+            if (it->isEmpty())
+                storage.erase(it);
+        }
+    }
+
+    struct ExtensionValidation {
+        enum Error {
+            NoError,
+            DuplicatedId,
+            DuplicatedCategories,
+        };
+
+        const ActionExtension *extension = nullptr;
+        QHash<QString, ActionObjectInfo> objects;
+        QSet<QByteArrayList> categories;
+
+        Error error = NoError;
+        QString id;
+        QByteArrayList duplicatedCategories;
+    };
+
+    // Checks an extension against the registered objects, only reads the domain
+    class ExtensionValidator {
+    public:
+        using result_type = ExtensionValidation;
+
+        explicit ExtensionValidator(const ActionDomainPrivate *d) : d(d) {
+        }
 
-        // Build map
-        auto &map = iconStorage.storage;
-        map.clear();
-        for (const auto &keys : std::as_const(iconStorage.items)) {
-            if (keys.size() == 1) {
-                auto configMap = iconStorage.configFiles.value(keys[0]);
-                for (auto it = configMap.begin(); it != configMap.end(); ++it) {
-                    auto &from = it.value();
-                    auto &to = map[it.key()];
-                    for (auto it2 = from.begin(); it2 != from.end(); ++it2) {
-                        to.insert(it2.key(), it2.value());
-                    }
+        ExtensionValidation operator()(const ActionExtension *extension) const {
+            ExtensionValidation res;
+            res.extension = extension;
+            res.objects.reserve(extension->objectCount());
+            for (int i = 0; i < extension->objectCount(); ++i) {
+                auto obj = extension->object(i);
+                auto id = obj.id();
+                if (d->objectInfoMap.contains(id)) {
+                    res.error = ExtensionValidation::DuplicatedId;
+                    res.id = id;
+                    break;
                 }
-            } else {
-                map[keys[0]][keys[1]] = iconStorage.singles.value(keys[0]).value(keys[1]);
+                auto categories = obj.categories();
+                if (d->objectCategories.contains(categories)) {
+                    res.error = ExtensionValidation::DuplicatedCategories;
+                    res.duplicatedCategories = categories;
+                    break;
+                }
+                res.objects.insert(id, obj);
+                res.categories.insert(categories);
             }
+            return res;
         }
-    }
+
+    private:
+        const ActionDomainPrivate *d;
+    };
+
+    // Batches with fewer objects are validated in place. The value is an estimate, the default
+    // sizes of actionlayout_bench fall on both sides of it.
+    static const int ParallelValidationObjects = 4096;
 
     ActionDomain::ActionDomain(QObject *parent) : ActionDomain(*new ActionDomainPrivate(), parent) {
     }
     ActionDomain::~ActionDomain() = default;
 
-    QByteArray ActionDomain::saveLayouts() const {
+    QByteArray ActionDomain::saveLayouts(LayoutsFormat format) const {
         Q_D(const ActionDomain);
         d->flushLayouts();
-        return LayoutsHelper::serialize(d->extensions, d->layouts.value());
+        if (format == XmlLayouts)
+            return LayoutsHelper::serialize(d->extensions, d->layouts.value());
+        return LayoutsHelper::serializeBinary(d->extensions, d->layouts.value());
     }
     bool ActionDomain::restoreLayouts(const QByteArray &data) {
         Q_D(ActionDomain);
 
         bool ok;
-        auto layouts = LayoutsHelper(d->extensions, d->objectInfoMap).restore(data, &ok);
+        auto layouts =
+            LayoutsHelper(d->extensions, d->objectIds, d->objectInfos).restore(data, &ok);
         if (!ok)
             return false;
 
@@ -774,6 +1925,23 @@ namespace Core {
         }
         return true;
     }
+    bool ActionDomain::restoreLayoutsFromFile(const QString &fileName) {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return false;
+        }
+
+        // Binary layouts are read from the mapped file directly
+        if (auto size = file.size(); size > 0) {
+            if (auto mapped = file.map(0, size)) {
+                bool res = restoreLayouts(
+                    QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), int(size)));
+                file.unmap(mapped);
+                return res;
+            }
+        }
+        return restoreLayouts(file.readAll());
+    }
     ActionDomain::ShortcutsFamily ActionDomain::shortcutsFamily() const {
         Q_D(const ActionDomain);
         return d->overriddenShortcuts;
@@ -825,24 +1993,169 @@ namespace Core {
             objectCategories.insert(categories);
         }
 
+        // The built layouts stay valid only if no registered extension refers to the new objects
+        bool referred = false;
         for (auto it = objectInfoMapTemp.begin(); it != objectInfoMapTemp.end(); ++it) {
             d->objectInfoMap.append(it.key(), it.value());
+            d->setObjectInfo(it.key(), it.value());
+            if (d->catalog) {
+                ActionDomainPrivate::insertCatalogItem(d->catalog.value(), it.value());
+            }
+            if (d->searchIndex) {
+                d->searchIndex->insert(it.key(), ActionDomainPrivate::searchTexts(it.value()));
+            }
+            referred |= d->layoutReferences.contains(it.key());
         }
         d->objectCategories += objectCategories;
+        d->catalogUndoHash = d->catalog ? extension->hash() : QString();
+        d->changeLayoutReferences(extension, 1);
 
         d->extensions.append(extension->hash(), extension);
+        if (d->layoutsState) {
+            if (referred || !LayoutsHelper(d->extensions, d->objectIds, d->objectInfos)
+                                 .applyExtension(d->layoutsState.value(), extension)) {
+                d->layoutsState.reset();
+            }
+        }
+        d->layouts.reset();
+    }
+    void ActionDomain::addExtensions(const QList<const ActionExtension *> &extensions) {
+        Q_D(ActionDomain);
+
+        // The extensions are checked against the registered objects, then against each other in
+        // order, so the result is the same as adding them one by one. Large batches are checked
+        // in the thread pool, waking it costs more than the checks of small ones.
+        const ExtensionValidator validate(d);
+        int objectCount = 0;
+        for (const auto &extension : extensions) {
+            objectCount += extension->objectCount();
+        }
+        QVector<ExtensionValidation> validations;
+        if (extensions.size() > 1 && objectCount >= ParallelValidationObjects) {
+            validations =
+                QtConcurrent::blockingMapped<QVector<ExtensionValidation>>(extensions, validate);
+        } else {
+            validations.reserve(extensions.size());
+            for (const auto &extension : extensions) {
+                validations.append(validate(extension));
+            }
+        }
+
+        QSet<QString> hashes;
+        QSet<QString> ids;
+        QSet<QByteArrayList> objectCategories;
+        QVector<const ExtensionValidation *> accepted;
+        accepted.reserve(validations.size());
+        for (const auto &item : validations) {
+            auto hash = item.extension->hash();
+            if (d->extensions.contains(hash) || hashes.contains(hash)) {
+                qWarning().noquote().nospace()
+                    << "Core::ActionDomain::addExtensions(): duplicated extension hash " << hash;
+                continue;
+            }
+
+            switch (item.error) {
+                case ExtensionValidation::DuplicatedId:
+                    qWarning().noquote().nospace()
+                        << "Core::ActionDomain::addExtensions(): duplicated object id " << item.id;
+                    continue;
+                case ExtensionValidation::DuplicatedCategories:
+                    qWarning().noquote().nospace()
+                        << "Core::ActionDomain::addExtensions(): duplicated object categories "
+                        << item.duplicatedCategories;
+                    continue;
+                default:
+                    break;
+            }
+
+            bool duplicated = false;
+            for (auto it = item.objects.begin(); it != item.objects.end(); ++it) {
+                if (ids.contains(it.key())) {
+                    qWarning().noquote().nospace()
+                        << "Core::ActionDomain::addExtensions(): duplicated object id "
+                        << it.key();
+                    duplicated = true;
+                    break;
+                }
+            }
+            if (duplicated)
+                continue;
+            for (const auto &categories : item.categories) {
+                if (objectCategories.contains(categories)) {
+                    qWarning().noquote().nospace()
+                        << "Core::ActionDomain::addExtensions(): duplicated object categories "
+                        << categories;
+                    duplicated = true;
+                    break;
+                }
+            }
+            if (duplicated)
+                continue;
+
+            hashes.insert(hash);
+            for (auto it = item.objects.begin(); it != item.objects.end(); ++it) {
+                ids.insert(it.key());
+            }
+            objectCategories += item.categories;
+            accepted.append(&item);
+        }
+
+        if (accepted.isEmpty())
+            return;
+
+        // Merge and invalidate once
+        for (const auto &item : std::as_const(accepted)) {
+            for (auto it = item->objects.begin(); it != item->objects.end(); ++it) {
+                d->objectInfoMap.append(it.key(), it.value());
+                d->setObjectInfo(it.key(), it.value());
+                if (d->searchIndex) {
+                    d->searchIndex->insert(it.key(), ActionDomainPrivate::searchTexts(it.value()));
+                }
+            }
+            d->changeLayoutReferences(item->extension, 1);
+            d->extensions.append(item->extension->hash(), item->extension);
+        }
+        d->objectCategories += objectCategories;
+
         d->catalog.reset();
+        d->catalogUndoHash.clear();
+        d->layoutsState.reset();
         d->layouts.reset();
     }
     void ActionDomain::removeExtension(const ActionExtension *extension) {
         Q_D(ActionDomain);
+        auto hash = extension->hash();
+        if (!d->extensions.contains(hash))
+            return;
+
+        // Only the last added extension can be taken back in place
+        bool catalogUndo = d->catalog && d->catalogUndoHash == hash;
         for (int i = 0; i < extension->objectCount(); ++i) {
             auto obj = extension->object(i);
             d->objectInfoMap.remove(obj.id());
+            d->setObjectInfo(obj.id(), {});
             d->objectCategories.remove(obj.categories());
+            if (d->searchIndex) {
+                d->searchIndex->remove(obj.id());
+            }
+            if (catalogUndo && !ActionDomainPrivate::removeCatalogItem(d->catalog.value(), obj))
+                catalogUndo = false;
+        }
+        if (!catalogUndo) {
+            d->catalog.reset();
+        }
+        d->catalogUndoHash.clear();
+        d->changeLayoutReferences(extension, -1);
+
+        d->extensions.remove(hash);
+        if (d->layoutsState) {
+            const auto &undo = d->layoutsState->undo;
+            if (undo && undo->hash == hash) {
+                LayoutsHelper::rollback(d->layoutsState.value());
+            } else {
+                d->layoutsState.reset();
+            }
         }
-        d->extensions.remove(extension->hash());
-        d->catalog.reset();
         d->layouts.reset();
     }
     void ActionDomain::addIcon(const QString &theme, const QString &id, const QString &fileName) {
@@ -864,19 +2177,66 @@ namespace Core {
     }
     void ActionDomain::addIconConfiguration(const QString &fileName) {
         Q_D(ActionDomain);
-        if (!QFileInfo(fileName).isFile()) {
+        QFileInfo info(fileName);
+        if (!info.isFile()) {
             return;
         }
 
+        // Start parsing now, the result is used by the next flush
         ActionDomainPrivate::IconChange::Config itemToBeAdded{
             fileName,
             false,
+            info.lastModified(),
+            info.size(),
+            {},
         };
+        auto it = d->iconConfigCache.constFind(fileName);
+        if (it == d->iconConfigCache.cend() || it->lastModified != itemToBeAdded.lastModified ||
+            it->size != itemToBeAdded.size) {
+            itemToBeAdded.future = QtConcurrent::run(parseIconConfiguration, fileName);
+        }
         auto &items = d->iconChange.items;
         QStringList keys = {fileName};
         items.remove(keys);
         items.append({fileName}, {itemToBeAdded});
     }
+    void ActionDomain::addIconBundle(const QString &fileName) {
+        Q_D(ActionDomain);
+        QFileInfo info(fileName);
+        if (!info.isFile()) {
+            return;
+        }
+
+        auto bundle = QSharedPointer<ActionIconBundle>::create();
+        if (!bundle->open(fileName)) {
+            return;
+        }
+        d->iconBundles.insert(fileName, bundle);
+
+        // The index is read already, merge it as a configuration
+        QHash<QString, QHash<QString, QString>> icons;
+        auto &themeMap = icons[bundle->theme];
+        for (int i = 0; i < bundle->entries.size(); ++i) {
+            themeMap.insert(bundle->entries.at(i).id, iconBundleReference(fileName, i));
+        }
+        QFutureInterface<QHash<QString, QHash<QString, QString>>> result;
+        result.reportStarted();
+        result.reportResult(icons);
+        result.reportFinished();
+
+        ActionDomainPrivate::IconChange::Config itemToBeAdded{
+            fileName, false, info.lastModified(), info.size(), result.future(),
+        };
+        auto &items = d->iconChange.items;
+        QStringList keys = {fileName};
+        items.remove(keys);
+        items.append(keys, itemToBeAdded);
+    }
+    void ActionDomain::removeIconBundle(const QString &fileName) {
+        Q_D(ActionDomain);
+        d->iconBundles.remove(fileName);
+        removeIconConfiguration(fileName);
+    }
     void ActionDomain::removeIcon(const QString &theme, const QString &id) {
         Q_D(ActionDomain);
         auto &items = d->iconChange.items;
@@ -930,86 +2290,125 @@ namespace Core {
     QIcon ActionDomain::icon(const QString &theme, const QString &iconId) const {
         Q_D(const ActionDomain);
         d->flushIcons();
-        auto icon = QIcon(d->iconStorage.storage.value(theme).value(iconId));
-        if (!icon.isNull())
-            return {};
-        return QIcon(d->iconStorage.storage.value({}).value(iconId)); // fallback
+        auto fileName = d->iconStorage.storage.value(theme).value(iconId);
+        if (fileName.isEmpty())
+            fileName = d->iconStorage.storage.value({}).value(iconId); // fallback
+        return d->cachedIcon(fileName);
+    }
+    QIcon ActionDomain::objectIcon(const QString &theme, const QString &objId) const {
+        Q_D(const ActionDomain);
+        if (auto o = icon(objId); o) {
+            return o->fromFile() ? d->cachedIcon(o->data()) : icon(theme, o->data());
+        }
+        return icon(theme, objId);
+    }
+    QList<ActionSearchIndex::Match> ActionDomain::searchObjects(const QString &pattern,
+                                                                int limit) const {
+        Q_D(const ActionDomain);
+        d->flushSearchIndex();
+        return d->searchIndex->search(pattern, limit);
+    }
+    QString ActionDomain::iconCacheDirectory() const {
+        Q_D(const ActionDomain);
+        return d->iconCacheDirectory;
+    }
+    void ActionDomain::setIconCacheDirectory(const QString &dir) {
+        Q_D(ActionDomain);
+        if (dir == d->iconCacheDirectory)
+            return;
+        d->iconCacheDirectory = dir;
+        d->iconCache.clear();
     }
     QList<ActionLayout> ActionDomain::layouts() const {
         Q_D(const ActionDomain);
         d->flushLayouts();
         return d->layouts.value();
     }
-    bool ActionDomainPrivate::setLayouts_helper(const QList<ActionLayout> &layouts) const {
+    bool ActionDomainPrivate::setLayouts_helper(const QList<ActionLayout> &layouts,
+                                                const QList<QVector<int>> *menuReferences) const {
+        // Vertices are the interned ids
         class TopologicalSorter {
         private:
-            QMap<QString, QSet<QString>> graph;
-            QMap<QString, int> inDegree;
+            QVector<QVector<int>> graph;
+            QVector<int> inDegree; // -1 if not a vertex
+            QVector<int> lastTarget;
+            int vertexCount = 0;
+
+            inline void addVertex(int u) {
+                if (inDegree.at(u) < 0) {
+                    inDegree[u] = 0;
+                    vertexCount++;
+                }
+            }
 
         public:
-            QStringList result;
-
-            void addEdge(const QString &u, const QString &v) {
-                // Avoid duplicated edge
-                if (!graph[u].contains(v)) {
-                    graph[u].insert(v);
-                    if (!inDegree.contains(u)) {
-                        inDegree[u] = 0;
-                    }
-                    inDegree[u];
-                    inDegree[v]++;
-                }
+            explicit TopologicalSorter(int size)
+                : graph(size), inDegree(size, -1), lastTarget(size, -1) {
+            }
+
+            // The edges to a vertex are added together, so a duplicated edge is the last one
+            void addEdge(int u, int v) {
+                if (lastTarget.at(u) == v)
+                    return;
+                lastTarget[u] = v;
+                graph[u].append(v);
+                addVertex(u);
+                addVertex(v);
+                inDegree[v]++;
             }
 
             bool sort() {
-                QQueue<QString> queue;
-                QStringList sorted;
+                QVector<int> queue;
+                queue.reserve(vertexCount);
 
                 // Add all non-in degrees
-                for (auto it = inDegree.begin(); it != inDegree.end(); ++it) {
-                    if (it.value() == 0) {
-                        queue.enqueue(it.key());
+                for (int u = 0; u < inDegree.size(); ++u) {
+                    if (inDegree.at(u) == 0) {
+                        queue.append(u);
                     }
                 }
 
-                while (!queue.isEmpty()) {
-                    QString u = queue.dequeue();
-                    sorted.append(u);
-                    for (const QString &v : std::as_const(graph[u])) {
-                        inDegree[v]--;
-                        if (inDegree[v] == 0) {
-                            queue.enqueue(v);
+                for (int i = 0; i < queue.size(); ++i) {
+                    for (const auto &v : std::as_const(graph.at(queue.at(i)))) {
+                        if (--inDegree[v] == 0) {
+                            queue.append(v);
                         }
                     }
                 }
 
                 // Loop exists if there are degrees that hasn't been processed
-                if (sorted.size() != graph.size()) {
+                if (queue.size() != vertexCount) {
                     qWarning().noquote().nospace()
                         << "Core::ActionDomain::setLayouts(): recursive chain detected";
                     return false;
                 }
-
-                result = sorted;
                 return true;
             }
         };
 
-        TopologicalSorter sorter;
-        QHash<QString, ActionLayout> layoutMap;
-        layoutMap.reserve(layouts.size());
-        for (const auto &layout : layouts) {
+        TopologicalSorter sorter(objectIds.size());
+        QVector<bool> rootKeys(objectIds.size(), false);
+        for (int i = 0; i < layouts.size(); ++i) {
+            const auto &layout = layouts.at(i);
             auto id = layout.id();
-            auto it = objectInfoMap.find(id);
-            if (it == objectInfoMap.end())
+            int key = objectIds.indexOf(id);
+            if (objectInfo(key).isNull())
                 continue;
 
-            if (layoutMap.contains(id)) {
+            if (rootKeys.at(key)) {
                 qWarning().noquote().nospace()
                     << "Core::ActionDomain::setLayouts(): duplicated layout root id " << id;
                 return false;
             }
-            layoutMap.insert(id, layout);
+            rootKeys[key] = true;
+
+            // Use the references collected along with the layouts if any
+            if (menuReferences) {
+                for (const auto &childKey : menuReferences->at(i)) {
+                    sorter.addEdge(childKey, key);
+                }
+                continue;
+            }
 
             std::list<ActionLayout> stack;
             stack.push_back(layout);
@@ -1020,12 +2419,13 @@ namespace Core {
                     const auto &childId = item.id();
                     if (childId.isEmpty())
                         continue;
-                    auto it2 = objectInfoMap.find(childId);
-                    if (it2 == objectInfoMap.end())
+                    int childKey = objectIds.indexOf(childId);
+                    auto info = objectInfo(childKey);
+                    if (info.isNull())
                         continue;
-                    if (it2->type() == ActionObjectInfo::Menu &&
-                        it2->mode() != ActionObjectInfo::Plain) {
-                        sorter.addEdge(item.id(), id);
+                    if (info.type() == ActionObjectInfo::Menu &&
+                        info.mode() != ActionObjectInfo::Plain) {
+                        sorter.addEdge(childKey, key);
                     }
                     if (!item.children().isEmpty()) {
                         stack.push_back(item);
@@ -1036,22 +2436,19 @@ namespace Core {
 
         // Topologically sort all the top-level menus, the front ones are included by some of the
         // back ones
-        bool ok;
         if (!sorter.sort()) {
             return false;
         }
 
-        QList<ActionLayout> result;
-        for (const auto &id : std::as_const(sorter.result)) {
-            result.append(layoutMap.value(id));
-        }
         this->layouts = layouts;
+        layoutPlan.reset();
         return true;
     }
     void ActionDomain::setLayouts(const QList<ActionLayout> &layouts) {
         Q_D(ActionDomain);
         if (!d->setLayouts_helper(layouts)) {
             d->layouts = QList<ActionLayout>();
+            d->layoutPlan.reset();
         }
     }
     void ActionDomain::resetLayouts() {
@@ -1090,31 +2487,299 @@ namespace Core {
         d->overriddenIcons.clear();
     }
 
-    void ActionDomainPrivate::buildLayoutsRecursively(
-        const Core::ActionLayout &layout, QWidget *parent,
-        const QHash<QString, QPair<Core::ActionItem *, Core::ActionObjectInfo>> &itemMap,
-        QHash<QWidget *, int> &lastMenuItems, QHash<QString, QMenu *> &autoCreatedStandaloneMenus,
-        QHash<QString, ActionLayout> &standaloneLayouts) const {
+    // Dynamic property of a container listing the actions installed by the last build
+    static const char installedActionsProperty[] = "action-domain-installed-actions";
+
+    QMenu *ActionDomainPrivate::BuildContext::requestMenu(ActionItem *item, QWidget *parent,
+                                                          const QString &id) {
+        QMenu *menu = nullptr;
+        auto it = oldMenus.find({parent, id});
+        if (it != oldMenus.end()) {
+            auto &menus = it.value();
+            while (!menus.isEmpty() && !menu) {
+                menu = menus.takeFirst();
+            }
+        }
+        if (!menu) {
+            // The menus of the shared item come from the factory of this build
+            if (item == sharedMenuItem) {
+                if (!state->menuFactory)
+                    return nullptr;
+                menu = state->menuFactory(parent);
+                if (menu)
+                    item->addMenuAsRequested(menu);
+            } else {
+                menu = item->requestMenu(parent);
+            }
+            if (!menu)
+                return nullptr;
+            statistics.createdMenus++;
+        }
+        addContainer(menu);
+        return menu;
+    }
+
+    QAction *ActionDomainPrivate::BuildContext::requestSeparator(QWidget *parent) {
+        auto &separators = oldSeparators[parent];
+        if (!separators.isEmpty())
+            return separators.takeFirst();
+
+        auto action = new QAction(parent);
+        action->setSeparator(true);
+        return action;
+    }
+
+    void ActionDomainPrivate::BuildContext::addContainer(QWidget *w) {
+        if (containerActions.contains(w))
+            return;
+        containers.append(w);
+        containerActions.insert(w, {});
+
+        // Only the actions installed by the last build are managed, the ones added by the
+        // application stay where they are
+        auto &installed = installedActions[w];
+        auto &separators = oldSeparators[w];
+        const auto lastActions = w->property(installedActionsProperty)
+                                     .value<QList<QPointer<QAction>>>();
+        for (const auto &action : lastActions) {
+            if (!action)
+                continue;
+            installed.insert(action);
+
+            // Separators are created by the build, reuse them
+            if (action->isSeparator() && action->parent() == w)
+                separators.append(action);
+        }
+    }
+
+    void ActionDomainPrivate::BuildContext::addAction(QWidget *w, QAction *action) {
+        addContainer(w);
+
+        // Adding an action twice moves it to the end
+        auto &actions = containerActions[w];
+        actions.removeOne(action);
+        actions.append(action);
+    }
+
+    void ActionDomainPrivate::BuildContext::removeLastAction(QWidget *w) {
+        auto &actions = containerActions[w];
+        if (actions.isEmpty())
+            return;
+        auto action = actions.takeLast();
+        if (action->isSeparator() && action->parent() == w) {
+            oldSeparators[w].prepend(action);
+        }
+    }
+
+    void ActionDomainPrivate::BuildContext::commit() {
+        for (const auto &w : std::as_const(containers)) {
+            const auto &actions = containerActions[w];
+            const auto &installed = installedActions[w];
+            QSet<QAction *> actionSet(actions.begin(), actions.end());
+
+            bool touched = false;
+            auto current = w->actions();
+            QList<QAction *> managed; // actions of the domain in the order of the container
+            for (int i = current.size() - 1; i >= 0; --i) {
+                auto action = current.at(i);
+                if (actionSet.contains(action)) {
+                    managed.prepend(action);
+                    continue;
+                }
+                if (!installed.contains(action))
+                    continue;
+                w->removeAction(action);
+                current.removeAt(i);
+                statistics.removedActions++;
+                touched = true;
+            }
+
+            // QWidget::insertAction() moves an action that is already installed, the new ones
+            // go after the last managed action
+            for (int i = 0; i < actions.size(); ++i) {
+                auto action = actions.at(i);
+                if (i < managed.size() && managed.at(i) == action)
+                    continue;
+
+                QAction *before = nullptr;
+                if (i < managed.size()) {
+                    before = managed.at(i);
+                } else if (!managed.isEmpty()) {
+                    before = current.value(current.indexOf(managed.last()) + 1, nullptr);
+                }
+                w->insertAction(before, action);
+                if (int oldIndex = managed.indexOf(action); oldIndex >= 0) {
+                    managed.removeAt(oldIndex);
+                    current.removeOne(action);
+                    statistics.movedActions++;
+                } else {
+                    statistics.insertedActions++;
+                }
+                managed.insert(i, action);
+                current.insert(before ? current.indexOf(before) : current.size(), action);
+                touched = true;
+            }
+            if (touched)
+                statistics.touchedContainers++;
+
+            QList<QPointer<QAction>> installedList;
+            installedList.reserve(actions.size());
+            for (const auto &action : actions) {
+                installedList.append(action);
+            }
+            w->setProperty(installedActionsProperty, QVariant::fromValue(installedList));
+        }
+
+        // Remove what is left from the last build
+        for (const auto &separators : std::as_const(oldSeparators)) {
+            qDeleteAll(separators);
+        }
+        oldSeparators.clear();
+        for (const auto &menus : std::as_const(oldMenus)) {
+            for (const auto &menu : menus) {
+                if (!menu)
+                    continue;
+                delete menu.data();
+                statistics.deletedMenus++;
+            }
+        }
+        oldMenus.clear();
+    }
+
+    class LazyMenuPopulator : public QObject {
+    public:
+        explicit LazyMenuPopulator(QMenu *menu) : QObject(menu) {
+            setObjectName(QStringLiteral("action-domain-populator"));
+            connect(menu, &QMenu::aboutToShow, this, &LazyMenuPopulator::populate);
+        }
+
+        QPointer<const ActionDomain> domain;
+        int index = -1;
+        QSharedPointer<ActionDomainPrivate::BuildState> state;
+
+        static LazyMenuPopulator *get(QMenu *menu) {
+            return static_cast<LazyMenuPopulator *>(menu->findChild<QObject *>(
+                QStringLiteral("action-domain-populator"), Qt::FindDirectChildrenOnly));
+        }
+
+    private:
+        void populate() {
+            auto menu = static_cast<QMenu *>(parent());
+            disconnect(menu, &QMenu::aboutToShow, this, &LazyMenuPopulator::populate);
+            if (domain) {
+                ActionDomainPrivate::get(domain)->populateMenu(menu, index, state);
+            }
+            deleteLater();
+        }
+    };
+
+    void ActionDomainPrivate::deferMenu(QMenu *menu, int index, BuildContext &ctx) const {
+        Q_Q(const ActionDomain);
+        auto populator = LazyMenuPopulator::get(menu);
+        if (!populator) {
+            populator = new LazyMenuPopulator(menu);
+        }
+        populator->domain = q;
+        populator->index = index;
+        populator->state = ctx.state;
+    }
+
+    void ActionDomainPrivate::populateMenu(QMenu *menu, int index,
+                                           const QSharedPointer<BuildState> &state) const {
+        BuildContext ctx;
+        ctx.state = state;
+        ctx.sharedMenuItem = sharedMenuItem.data();
+
+        // Same as a build of the subtree, the separator and stretch rules apply to the new
+        // container only
+        menu->setProperty("action-domain-populated", true);
+        buildChildLayouts(index, menu, ctx);
+        ctx.commit();
+    }
+
+    void ActionDomainPrivate::flushLayoutPlan() const {
+        flushLayouts();
+        if (layoutPlan)
+            return;
+
+        auto plan = QSharedPointer<ActionLayoutPlan>::create();
+        plan->slotIndexes.fill(-1, objectIds.size());
+        auto &instructions = plan->instructions;
+        std::function<void(const ActionLayout &)> compile = [&](const ActionLayout &layout) {
+            int index = instructions.size();
+            instructions.append({});
+
+            ActionLayoutPlan::Instruction ins;
+            ins.type = layout.type();
+            // The unknown ids are not interned, they are never built anyway
+            if (int key = objectIds.indexOf(layout.id()); key >= 0) {
+                auto &slot = plan->slotIndexes[key];
+                if (slot < 0) {
+                    slot = plan->ids.size();
+                    plan->ids.append(objectIds.id(key));
+                }
+                ins.slot = slot;
+
+                auto info = objectInfo(key);
+                if (!info.isNull()) {
+                    ins.known = true;
+                    ins.plain = info.mode() == ActionObjectInfo::Plain;
+                    ins.objectType = info.type();
+                }
+            }
+            for (const auto &child : layout.children()) {
+                compile(child);
+            }
+            ins.end = instructions.size();
+            instructions[index] = ins;
+        };
+
+        for (const auto &layout : layouts.value()) {
+            plan->roots.append(instructions.size());
+            compile(layout);
+        }
+        layoutPlan = plan;
+    }
+
+    void ActionDomainPrivate::buildChildLayouts(int index, QWidget *parent,
+                                                BuildContext &ctx) const {
+        const auto &instructions = ctx.state->plan->instructions;
+        for (int i = index + 1; i < instructions.at(index).end; i = instructions.at(i).end) {
+            buildLayoutsRecursively(i, parent, ctx);
+        }
+    }
+
+    void ActionDomainPrivate::buildLayoutsRecursively(int index, QWidget *parent,
+                                                      BuildContext &ctx) const {
         enum LastMenuItem {
             Action,
             Separator,
             Stretch,
         };
-        const auto &id = layout.id();
-        switch (layout.type()) {
+        auto &lastMenuItems = ctx.lastMenuItems;
+        auto &state = *ctx.state;
+        auto &autoCreatedStandaloneMenus = state.autoCreatedStandaloneMenus;
+        auto &standaloneLayouts = state.standaloneLayouts;
+
+        const auto &ins = state.plan->instructions.at(index);
+        const auto &slot = ins.slot;
+        if (slot < 0 && ins.type != ActionLayoutInfo::Separator &&
+            ins.type != ActionLayoutInfo::Stretch) {
+            return;
+        }
+        switch (ins.type) {
             case ActionLayoutInfo::Action: {
                 if (!parent)
                     break;
-                auto pair = itemMap.value(id);
-                auto actionItem = pair.first;
-                if (!actionItem || pair.second.type() != ActionObjectInfo::Action) {
+                ActionItem *actionItem = state.items.at(slot);
+                if (!actionItem || ins.objectType != ActionObjectInfo::Action) {
                     break;
                 }
                 if (actionItem->isAction()) {
-                    parent->addAction(actionItem->action());
+                    ctx.addAction(parent, actionItem->action());
                     lastMenuItems[parent] = Action;
                 } else if (actionItem->isWidget()) {
-                    parent->addAction(actionItem->widgetAction());
+                    ctx.addAction(parent, actionItem->widgetAction());
                     lastMenuItems[parent] = Action;
                 }
                 break;
@@ -1122,168 +2787,165 @@ namespace Core {
             case ActionLayoutInfo::ExpandedMenu: {
                 if (!parent)
                     break;
-                auto info = objectInfoMap.value(id);
-                if (info.isNull() || info.type() != ActionObjectInfo::Menu)
+                if (!ins.known || ins.objectType != ActionObjectInfo::Menu)
                     break;
 
-                auto pair = itemMap.value(id);
-                auto actionItem = pair.first;
-                auto nextLayout = layout;
-                if (info.mode() != ActionObjectInfo::Plain) {
-                    auto it = standaloneLayouts.find(id);
-                    if (it == standaloneLayouts.end()) {
+                ActionItem *actionItem = state.items.at(slot);
+                auto nextIndex = index;
+                if (!ins.plain) {
+                    auto cachedIndex = standaloneLayouts.at(slot);
+                    if (cachedIndex < 0) {
                         QWidget *thisParent;
                         if (actionItem) {
                             thisParent = actionItem->standalone();
+                            if (thisParent)
+                                ctx.addContainer(thisParent);
                         } else {
-                            auto menu = autoCreatedStandaloneMenus.value(id);
+                            QMenu *menu = autoCreatedStandaloneMenus.at(slot);
                             if (!menu) {
-                                menu = sharedMenuItem->requestMenu(parent);
+                                const auto &id = state.plan->ids.at(slot);
+                                menu = ctx.requestMenu(sharedMenuItem.data(), parent, id);
                                 if (!menu)
                                     break;
-                                autoCreatedStandaloneMenus.insert(id, menu);
-
+                                autoCreatedStandaloneMenus[slot] = menu;
                                 menu->setProperty("action-item-id", id);
-                                sharedMenuItem->addMenuAsRequested(menu);
                             }
                             thisParent = menu;
                         }
 
                         // Construct for the first time and cache the layout
-                        for (const auto &childLayoutItem : layout.children()) {
-                            buildLayoutsRecursively(childLayoutItem, thisParent, itemMap,
-                                                    lastMenuItems, autoCreatedStandaloneMenus,
-                                                    standaloneLayouts);
-                        }
-                        standaloneLayouts.insert(id, layout);
+                        buildChildLayouts(index, thisParent, ctx);
+                        standaloneLayouts[slot] = index;
                     } else {
                         // Use the cached layout
-                        nextLayout = it.value();
+                        nextIndex = cachedIndex;
                     }
                 }
 
-                for (const auto &childLayoutItem : nextLayout.children()) {
-                    buildLayoutsRecursively(childLayoutItem, parent, itemMap, lastMenuItems,
-                                            autoCreatedStandaloneMenus, standaloneLayouts);
-                }
+                buildChildLayouts(nextIndex, parent, ctx);
                 break;
             }
             case ActionLayoutInfo::Group: {
                 if (!parent)
                     break;
-                auto info = objectInfoMap.value(id);
-                if (info.isNull() || info.type() != ActionObjectInfo::Group)
+                if (!ins.known || ins.objectType != ActionObjectInfo::Group)
                     break;
 
-                auto nextLayout = layout;
-                if (info.mode() != ActionObjectInfo::Plain) {
-                    auto it = standaloneLayouts.find(id);
-                    if (it == standaloneLayouts.end()) {
+                auto nextIndex = index;
+                if (!ins.plain) {
+                    auto cachedIndex = standaloneLayouts.at(slot);
+                    if (cachedIndex < 0) {
                         // Cache the layout for the first time
-                        standaloneLayouts.insert(id, layout);
+                        standaloneLayouts[slot] = index;
                     } else {
                         // Use the cached layout
-                        nextLayout = it.value();
+                        nextIndex = cachedIndex;
                     }
                 }
 
-                for (const auto &childLayoutItem : nextLayout.children()) {
-                    buildLayoutsRecursively(childLayoutItem, parent, itemMap, lastMenuItems,
-                                            autoCreatedStandaloneMenus, standaloneLayouts);
-                }
+                buildChildLayouts(nextIndex, parent, ctx);
                 break;
             }
             case ActionLayoutInfo::Menu: {
                 QWidget *nextParent;
-                auto pair = itemMap.value(id);
-                auto actionItem = pair.first;
+                QMenu *requestedMenu = nullptr;
+                ActionItem *actionItem = state.items.at(slot);
                 if (!actionItem) {
                     if (!parent)
                         break;
-                    auto info = objectInfoMap.value(id);
-                    if (info.isNull() || info.type() != ActionObjectInfo::Menu)
+                    if (!ins.known || ins.objectType != ActionObjectInfo::Menu)
                         break;
+                    const auto &id = state.plan->ids.at(slot);
                     QMenu *menu;
-                    if (info.mode() != ActionObjectInfo::Plain) {
-                        menu = autoCreatedStandaloneMenus.value(id);
+                    if (!ins.plain) {
+                        menu = autoCreatedStandaloneMenus.at(slot);
                         if (menu) {
-                            parent->addAction(menu->menuAction());
+                            ctx.addAction(parent, menu->menuAction());
                             lastMenuItems[parent] = Action;
                             break;
                         }
-                        menu = sharedMenuItem->requestMenu(parent);
+                        menu = ctx.requestMenu(sharedMenuItem.data(), parent, id);
                         if (!menu)
                             break;
-                        autoCreatedStandaloneMenus.insert(id, menu);
+                        autoCreatedStandaloneMenus[slot] = menu;
                     } else {
-                        menu = sharedMenuItem->requestMenu(parent);
+                        menu = ctx.requestMenu(sharedMenuItem.data(), parent, id);
                         if (!menu)
                             break;
                     }
                     menu->setProperty("action-item-id", id);
-                    sharedMenuItem->addMenuAsRequested(menu);
-                    parent->addAction(menu->menuAction());
+                    ctx.addAction(parent, menu->menuAction());
                     lastMenuItems[parent] = Action;
                     nextParent = menu;
+                    requestedMenu = menu;
                 } else {
-                    if (pair.second.type() != ActionObjectInfo::Menu)
+                    if (ins.objectType != ActionObjectInfo::Menu)
                         break;
                     if (actionItem->isStandalone()) {
                         auto w = actionItem->standalone();
                         if (parent) {
                             auto menu = qobject_cast<QMenu *>(w);
                             if (menu) {
-                                parent->addAction(menu->menuAction());
+                                ctx.addAction(parent, menu->menuAction());
                                 lastMenuItems[parent] = Action;
                             }
                         }
                         // other menu types will be ignored
                         nextParent = w;
 
-                        auto it = standaloneLayouts.find(id);
-                        if (it == standaloneLayouts.end()) {
+                        if (standaloneLayouts.at(slot) < 0) {
                             // Cache the layout
-                            standaloneLayouts.insert(id, layout);
+                            standaloneLayouts[slot] = index;
                         } else {
                             // Has been constructed
                             break;
                         }
+                        if (w)
+                            ctx.addContainer(w);
                     } else if (actionItem->isMenu()) {
                         if (!parent)
                             break;
-                        auto menu = actionItem->requestMenu(parent);
+                        auto menu = ctx.requestMenu(actionItem, parent, actionItem->id());
                         if (!menu) {
                             break;
                         }
-                        parent->addAction(menu->menuAction());
+                        ctx.addAction(parent, menu->menuAction());
                         lastMenuItems[parent] = Action;
                         nextParent = menu;
+                        requestedMenu = menu;
                     } else {
                         break;
                     }
                 }
-                for (const auto &childLayoutItem : layout.children()) {
-                    buildLayoutsRecursively(childLayoutItem, nextParent, itemMap, lastMenuItems,
-                                            autoCreatedStandaloneMenus, standaloneLayouts);
+
+                // Leave the submenu empty until it is shown for the first time
+                if (requestedMenu && lazyMenuPopulation) {
+                    if (!requestedMenu->property("action-domain-populated").toBool()) {
+                        deferMenu(requestedMenu, index, ctx);
+                        break;
+                    }
                 }
+                buildChildLayouts(index, nextParent, ctx);
                 break;
             }
             case ActionLayoutInfo::Separator: {
+                if (!parent)
+                    break;
                 if (lastMenuItems.value(parent) == Action) {
-                    auto action = new QAction(parent);
-                    action->setSeparator(true);
-                    parent->addAction(action);
+                    ctx.addAction(parent, ctx.requestSeparator(parent));
                     lastMenuItems[parent] = Separator;
                 }
                 break;
             }
             case ActionLayoutInfo::Stretch: {
+                if (!parent)
+                    break;
                 if (lastMenuItems.value(parent) == Action) {
-                    parent->addAction(sharedStretchWidgetAction.data());
+                    ctx.addAction(parent, sharedStretchWidgetAction.data());
                     lastMenuItems[parent] = Stretch;
                 } else if (lastMenuItems.value(parent) == Separator) {
-                    parent->removeAction(parent->actions().back());
-                    parent->addAction(sharedStretchWidgetAction.data());
+                    ctx.removeLastAction(parent);
+                    ctx.addAction(parent, sharedStretchWidgetAction.data());
                     lastMenuItems[parent] = Stretch;
                 }
                 break;
@@ -1291,92 +2953,150 @@ namespace Core {
         }
     }
 
+    bool ActionDomain::translationPrefill() const {
+        Q_D(const ActionDomain);
+        return d->translationPrefill;
+    }
+    void ActionDomain::setTranslationPrefill(bool prefill) {
+        Q_D(ActionDomain);
+        if (prefill == d->translationPrefill)
+            return;
+        d->translationPrefill = prefill;
+        if (prefill)
+            d->prefillTranslations();
+    }
+    bool ActionDomain::lazyMenuPopulation() const {
+        Q_D(const ActionDomain);
+        return d->lazyMenuPopulation;
+    }
+    void ActionDomain::setLazyMenuPopulation(bool lazy) {
+        Q_D(ActionDomain);
+        d->lazyMenuPopulation = lazy;
+    }
     bool ActionDomain::buildLayouts(const QList<ActionItem *> &items,
-                                    const ActionItem::MenuFactory &defaultMenuFactory) const {
+                                    const ActionItem::MenuFactory &defaultMenuFactory,
+                                    BuildStatistics *statistics) const {
         Q_D(const ActionDomain);
-        d->flushLayouts();
-
-        // Build item map
-        QHash<QString, QPair<ActionItem *, ActionObjectInfo>> itemMap;
-        itemMap.reserve(items.size());
+        d->flushLayoutPlan();
+
+        // The plan is compiled once for all the builds, each build only fills its item table
+        const auto &plan = d->layoutPlan;
+        ActionDomainPrivate::BuildContext ctx;
+        ctx.state = QSharedPointer<ActionDomainPrivate::BuildState>::create();
+        ctx.sharedMenuItem = d->sharedMenuItem.data();
+        auto &state = *ctx.state;
+        state.plan = plan;
+        state.items.resize(plan->ids.size());
+        state.autoCreatedStandaloneMenus.resize(plan->ids.size());
+        state.standaloneLayouts.fill(-1, plan->ids.size());
+        state.menuFactory = defaultMenuFactory;
+
+        // Build item table
+        QVector<bool> itemKeys(d->objectIds.size(), false);
         for (const auto &item : items) {
             auto id = item->id();
-            if (itemMap.contains(id)) {
+            int key = d->objectIds.indexOf(id);
+            if (d->objectInfo(key).isNull()) {
                 qWarning().noquote().nospace()
-                    << "Core::ActionDomain::buildLayouts(): duplicated item id " << id;
+                    << "Core::ActionDomain::buildLayouts(): unknown item id " << id;
                 continue;
             }
 
-            auto it = d->objectInfoMap.find(id);
-            if (it == d->objectInfoMap.end()) {
+            if (itemKeys.at(key)) {
                 qWarning().noquote().nospace()
-                    << "Core::ActionDomain::buildLayouts(): unknown item id " << id;
+                    << "Core::ActionDomain::buildLayouts(): duplicated item id " << id;
                 continue;
             }
-            itemMap.insert(id, {item, *it});
+            itemKeys[key] = true;
+
+            // The ids interned after the plan are not in the layouts
+            if (key >= plan->slotIndexes.size())
+                continue;
+            if (int slot = plan->slotIndexes.at(key); slot >= 0)
+                state.items[slot] = item;
         }
 
-        // Remove all menus
+        // Collect the menus of the last build, the ones not reused will be removed
         for (const auto &item : items) {
-            if (item->isMenu()) {
-                item->d_func()->deleteAllMenus();
+            if (!item->isMenu())
+                continue;
+            for (const auto &menu : item->createdMenus()) {
+                if (!menu)
+                    continue;
+                ctx.oldMenus[{menu->parentWidget(), item->id()}].append(menu);
             }
         }
-        d->sharedMenuItem->d_func()->deleteAllMenus();
-
-        if (d->layouts->isEmpty())
-            return true;
+        for (const auto &menu : d->sharedMenuItem->createdMenus()) {
+            if (!menu)
+                continue;
+            ctx.oldMenus[{menu->parentWidget(), menu->property("action-item-id").toString()}]
+                .append(menu);
+        }
 
         // Build layouts
-        auto &fac = d->sharedMenuItem->d_func()->menuFactory;
-        auto oldFac = fac;
-        fac = defaultMenuFactory;
-
-        QHash<QWidget *, int> lastMenuItems;
-        QHash<QString, QMenu *> autoCreatedStandaloneMenus;
-        QHash<QString, ActionLayout> standaloneLayouts;
-
         // For standalone menus or groups, because of the topological ordering in
         // setLayouts_helper(), we can be sure that the first encounter layout will be the
         // actual layout rather than the reference.
-        for (const auto &item : d->layouts.value()) {
-            auto pair = itemMap.value(item.id());
-            if (pair.second.type() != ActionObjectInfo::Menu ||
-                pair.second.mode() == ActionObjectInfo::Plain || !pair.first->isStandalone()) {
+        for (const auto &index : std::as_const(plan->roots)) {
+            const auto &ins = plan->instructions.at(index);
+            ActionItem *item = ins.slot >= 0 ? state.items.at(ins.slot).data() : nullptr;
+            if (!item || ins.objectType != ActionObjectInfo::Menu || ins.plain ||
+                !item->isStandalone()) {
                 continue;
             }
-            d->buildLayoutsRecursively(item, nullptr, itemMap, lastMenuItems,
-                                       autoCreatedStandaloneMenus, standaloneLayouts);
+            d->buildLayoutsRecursively(index, nullptr, ctx);
         }
-        fac = oldFac;
+
+        // Only install the differences
+        ctx.commit();
+        if (statistics)
+            *statistics = ctx.statistics;
         return true;
     }
+    // Only the targets showing something else are written, so that the actions and widgets not
+    // affected by a switch of the language or the theme don't notify or repaint
     void ActionDomain::updateTexts(const QList<ActionItem *> &items) const {
         Q_D(const ActionDomain);
+
+        // The items of several windows share the ids
+        QHash<QString, QString> texts;
+        auto textOf = [&](const QString &id) -> const QString * {
+            auto it = texts.find(id);
+            if (it == texts.end()) {
+                auto info = d->objectInfoMap.find(id);
+                if (info == d->objectInfoMap.end())
+                    return nullptr;
+                it = texts.insert(id, ActionObjectInfo::translatedText(info.value().text()));
+            }
+            return &it.value();
+        };
+        auto setMenuTitle = [](QMenu *menu, const QString &text) {
+            if (menu->title() != text)
+                menu->setTitle(text);
+        };
+
         for (const auto &item : items) {
-            auto it = d->objectInfoMap.find(item->id());
-            if (it == d->objectInfoMap.end())
+            auto text = textOf(item->id());
+            if (!text)
                 continue;
-            auto text = ActionObjectInfo::translatedText(it.value().text());
             switch (item->type()) {
                 case ActionItem::Action: {
-                    item->action()->setText(text);
+                    auto action = item->action();
+                    if (action->text() != *text)
+                        action->setText(*text);
                     break;
                 }
                 case ActionItem::Menu: {
                     for (const auto &menu : item->createdMenus()) {
-                        menu->setTitle(text);
+                        setMenuTitle(menu, *text);
                     }
                     break;
                 }
                 case ActionItem::Standalone: {
                     auto w = item->standalone();
-                    auto mo = item->standalone()->metaObject();
-                    if (auto idx = mo->indexOfProperty("text"); idx >= 0) {
-                        auto prop = mo->property(idx);
-                        if (prop.isWritable()) {
-                            prop.write(w, text);
-                        }
+                    if (auto prop = d->standaloneProperty(w, ActionDomainPrivate::TextProperty);
+                        prop.isValid() && prop.read(w).toString() != *text) {
+                        prop.write(w, *text);
                     }
                     break;
                 }
@@ -1385,35 +3105,52 @@ namespace Core {
             }
         }
         for (const auto &menu : d->sharedMenuItem->createdMenus()) {
-            auto it = d->objectInfoMap.find(menu->property("action-item-id").toString());
-            if (it == d->objectInfoMap.end())
-                continue;
-            auto text = ActionObjectInfo::translatedText(it.value().text());
-            menu->setTitle(text);
+            if (auto text = textOf(menu->property("action-item-id").toString()))
+                setMenuTitle(menu, *text);
         }
     }
     void ActionDomain::updateIcons(const QString &theme, const QList<ActionItem *> &items) const {
         Q_D(const ActionDomain);
+
+        // The icons are shared by file, an unchanged icon keeps its cache key
+        QHash<QString, QIcon> icons;
+        auto iconOf = [&](const QString &id) -> const QIcon & {
+            auto it = icons.find(id);
+            if (it == icons.end())
+                it = icons.insert(id, objectIcon(theme, id));
+            return it.value();
+        };
+        auto setMenuIcon = [](QMenu *menu, const QIcon &icon) {
+            if (menu->icon().cacheKey() != icon.cacheKey())
+                menu->setIcon(icon);
+        };
+
         for (const auto &item : items) {
             switch (item->type()) {
                 case ActionItem::Action: {
-                    item->action()->setIcon(objectIcon(theme, item->id()));
+                    auto action = item->action();
+                    const auto &icon = iconOf(item->id());
+                    if (action->icon().cacheKey() != icon.cacheKey())
+                        action->setIcon(icon);
                     break;
                 }
                 case ActionItem::Menu: {
-                    for (const auto &menu : item->createdMenus()) {
-                        menu->setIcon(objectIcon(theme, item->id()));
+                    const auto &menus = item->createdMenus();
+                    if (menus.isEmpty())
+                        break;
+                    const auto &icon = iconOf(item->id());
+                    for (const auto &menu : menus) {
+                        setMenuIcon(menu, icon);
                     }
                     break;
                 }
                 case ActionItem::Standalone: {
                     auto w = item->standalone();
-                    auto mo = item->standalone()->metaObject();
-                    if (auto idx = mo->indexOfProperty("icon"); idx >= 0) {
-                        auto prop = mo->property(idx);
-                        if (prop.isWritable()) {
-                            prop.write(w, objectIcon(theme, item->id()));
-                        }
+                    if (auto prop = d->standaloneProperty(w, ActionDomainPrivate::IconProperty);
+                        prop.isValid()) {
+                        const auto &icon = iconOf(item->id());
+                        if (prop.read(w).value<QIcon>().cacheKey() != icon.cacheKey())
+                            prop.write(w, icon);
                     }
                     break;
                 }
@@ -1422,7 +3159,7 @@ namespace Core {
             }
         }
         for (const auto &menu : d->sharedMenuItem->createdMenus()) {
-            menu->setIcon(objectIcon(theme, menu->property("action-item-id").toString()));
+            setMenuIcon(menu, iconOf(menu->property("action-item-id").toString()));
         }
     }
 
@@ -8,6 +8,7 @@
 
 #include <CoreApi/actionitem.h>
 #include <CoreApi/actionextension.h>
+#include <CoreApi/actionsearchindex.h>
 
 namespace Core {
 
@@ -39,6 +40,7 @@ namespace Core {
         QSharedDataPointer<ActionCatalogData> d;
 
         friend class ActionDomain;
+        friend class ActionDomainPrivate;
     };
 
     class ActionLayoutData;
@@ -99,8 +101,14 @@ namespace Core {
         using ShortcutsFamily = QHash<QString, ShortcutsOverride>;
         using IconFamily = QHash<QString, IconOverride>;
 
+        enum LayoutsFormat {
+            BinaryLayouts,
+            XmlLayouts,
+        };
+
     public:
         void addExtension(const ActionExtension *extension);
+        void addExtensions(const QList<const ActionExtension *> &extensions);
         void removeExtension(const ActionExtension *extension);
 
         void addIcon(const QString &theme, const QString &id, const QString &fileName);
@@ -108,9 +116,15 @@ namespace Core {
         void removeIcon(const QString &theme, const QString &id);
         void removeIconConfiguration(const QString &fileName);
 
+        void addIconBundle(const QString &fileName);
+        void removeIconBundle(const QString &fileName);
+
     public:
-        QByteArray saveLayouts() const;
+        // XML stays the default so that older versions can read the saved layouts, the binary
+        // format is faster to restore and has to be asked for
+        QByteArray saveLayouts(LayoutsFormat format = XmlLayouts) const;
         bool restoreLayouts(const QByteArray &data);
+        bool restoreLayoutsFromFile(const QString &fileName);
 
         ShortcutsFamily shortcutsFamily() const;
         void setShortcutsFamily(const ShortcutsFamily &shortcutsFamily);
@@ -142,10 +156,32 @@ namespace Core {
         void resetIcons();
 
         inline QList<QKeySequence> objectShortcuts(const QString &objId) const;
-        inline QIcon objectIcon(const QString &theme, const QString &objId) const;
+        QIcon objectIcon(const QString &theme, const QString &objId) const;
+
+        QList<ActionSearchIndex::Match> searchObjects(const QString &pattern,
+                                                      int limit = 50) const;
+
+        QString iconCacheDirectory() const;
+        void setIconCacheDirectory(const QString &dir);
+
+        struct BuildStatistics {
+            int touchedContainers = 0;
+            int insertedActions = 0;
+            int removedActions = 0;
+            int movedActions = 0;
+            int createdMenus = 0;
+            int deletedMenus = 0;
+        };
+
+        bool translationPrefill() const;
+        void setTranslationPrefill(bool prefill);
+
+        bool lazyMenuPopulation() const;
+        void setLazyMenuPopulation(bool lazy);
 
         bool buildLayouts(const QList<ActionItem *> &items,
-                          const ActionItem::MenuFactory &defaultMenuFactory = {}) const;
+                          const ActionItem::MenuFactory &defaultMenuFactory = {},
+                          BuildStatistics *statistics = nullptr) const;
         void updateTexts(const QList<ActionItem *> &items) const;
         void updateIcons(const QString &theme, const QList<ActionItem *> &items) const;
 
@@ -170,13 +206,6 @@ namespace Core {
         return objectInfo(objId).shortcuts();
     }
 
-    inline QIcon ActionDomain::objectIcon(const QString &theme, const QString &objId) const {
-        if (auto o = icon(objId); o) {
-            return o->fromFile() ? QIcon(o->data()) : icon(theme, o->data());
-        }
-        return icon(theme, objId);
-    }
-
 }
 
 #endif // ACTIONDOMAIN_H
\ No newline at end of file
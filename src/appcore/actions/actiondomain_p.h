@@ -2,14 +2,21 @@
 #define ACTIONDOMAINPRIVATE_H
 
 #include <list>
+#include <optional>
 #include <variant>
 
 #include <QSet>
+#include <QPointer>
+#include <QDateTime>
+#include <QFile>
+#include <QFuture>
+#include <QMetaProperty>
 
 #include <QMCore/qmchronoset.h>
 #include <QMCore/qmchronomap.h>
 
 #include <CoreApi/actiondomain.h>
+#include <CoreApi/actionsearchindex.h>
 
 QT_SPECIALIZE_STD_HASH_TO_CALL_QHASH_BY_CREF(QStringList)
 
@@ -30,6 +37,112 @@ namespace Core {
         QList<ActionLayout> children;
     };
 
+    // Object ids and the ids referred by the layouts interned to dense integers, an index is
+    // kept once assigned so that the layout states and plans can refer to it.
+    //
+    // Indexes are never reclaimed, the layout state holding the user's layouts and the plans
+    // kept by lazily populated menus may still refer to them. Only the ids of the extensions
+    // are interned, setLayouts() and restoreLayouts() only look ids up, so the table is bounded
+    // by the distinct ids of all extensions ever added and removing and adding the same
+    // extensions again doesn't grow it.
+    class ActionIdTable {
+    public:
+        inline int indexOf(const QString &id) const {
+            return indexes.value(id, -1);
+        }
+        inline QString id(int index) const {
+            return ids.at(index);
+        }
+        inline int size() const {
+            return ids.size();
+        }
+
+        int intern(const QString &id);
+
+    private:
+        QHash<QString, int> indexes;
+        QStringList ids;
+    };
+
+    // Layout tree built from the extensions, kept to apply the following extensions in place
+    class ActionLayoutsState {
+    public:
+        struct Node {
+            QString id;
+            int key = -1; // interned id, -1 for separators and stretches
+            ActionLayoutInfo::Type type = ActionLayoutInfo::Action;
+            QVector<int> children;
+            QVector<int> parents;
+
+            // Converted layout and the standalone menus referenced in the subtree, outdated if
+            // the node is dirty
+            bool dirty = true;
+            ActionLayout layout;
+            QVector<int> menuReferences; // sorted keys
+
+            inline Node(ActionLayoutInfo::Type type = ActionLayoutInfo::Action) : type(type) {
+            }
+        };
+
+        QVector<Node> heap;
+        QVector<QVector<int>> idIndexes; // by key
+        QVector<int> rootIndexes;
+
+        // Contribution of the last extension applied in place, so that it can be taken back
+        // if the extension is removed before any other change
+        struct Undo {
+            QString hash;
+            int heapSize = 0;
+            int rootCount = 0;
+            QHash<int, QVector<int>> children; // original children of the modified nodes
+        };
+        std::optional<Undo> undo;
+
+        void markDirty(int index);
+    };
+
+    // Layouts resolved against the objects as a flat pre-order array, replayed by the builds
+    class ActionLayoutPlan {
+    public:
+        struct Instruction {
+            ActionLayoutInfo::Type type = ActionLayoutInfo::Action;
+            int end = 0;   // index past the subtree
+            int slot = -1; // index of the object id, -1 for separators and stretches
+
+            // Object of the id
+            bool known = false;
+            bool plain = true;
+            ActionObjectInfo::Type objectType = ActionObjectInfo::Action;
+        };
+
+        QVector<Instruction> instructions;
+        QVector<int> roots;
+        QStringList ids;
+        QVector<int> slotIndexes; // by key, -1 if the id is not in the layouts
+    };
+
+    // Icons packed into one file per theme, the entries refer to the mapped file directly
+    class ActionIconBundle {
+    public:
+        struct Entry {
+            QString id;
+            QByteArray format;
+            QByteArray data;
+        };
+
+        ~ActionIconBundle();
+
+        bool open(const QString &fileName);
+
+        quint64 serial = 0;
+        QString theme;
+        QVector<Entry> entries;
+
+    private:
+        QFile file;
+        uchar *mapped = nullptr;
+    };
+
     class ActionDomainPrivate {
         Q_DECLARE_PUBLIC(ActionDomain)
     public:
@@ -38,17 +151,40 @@ namespace Core {
 
         void init();
 
+        static inline const ActionDomainPrivate *get(const ActionDomain *q) {
+            return q->d_func();
+        }
+
         ActionDomain *q_ptr;
 
         // Actions
         QMChronoMap<QString, const ActionExtension *> extensions; // hash -> ext
         QMChronoMap<QString, ActionObjectInfo> objectInfoMap;     // id -> obj
+        ActionIdTable objectIds;
+        QVector<ActionObjectInfo> objectInfos; // by key, null if the object is removed
         QSet<QByteArrayList> objectCategories;
         mutable std::optional<ActionCatalog> catalog;
         mutable std::optional<QList<ActionLayout>> layouts;
 
+        // Extensions are applied to the catalog and to the layout state in place when possible,
+        // the last one can be taken back the same way
+        mutable std::optional<ActionLayoutsState> layoutsState;
+        mutable QSharedPointer<const ActionLayoutPlan> layoutPlan;
+        QString catalogUndoHash;
+        QHash<QString, int> layoutReferences; // ids referred by the layouts and build routines
+
         void flushCatalog() const;
         void flushLayouts() const;
+        void flushLayoutPlan() const;
+
+        inline ActionObjectInfo objectInfo(int key) const {
+            return key >= 0 && key < objectInfos.size() ? objectInfos.at(key) : ActionObjectInfo();
+        }
+        void setObjectInfo(const QString &id, const ActionObjectInfo &info);
+
+        void changeLayoutReferences(const ActionExtension *extension, int delta);
+        static void insertCatalogItem(ActionCatalog &root, const ActionObjectInfo &info);
+        static bool removeCatalogItem(ActionCatalog &root, const ActionObjectInfo &info);
 
         // Icons
         struct IconChange {
@@ -61,6 +197,11 @@ namespace Core {
             struct Config {
                 QString fileName;
                 bool remove;
+
+                // Parsed in the thread pool since the configuration is added
+                QDateTime lastModified;
+                qint64 size;
+                QFuture<QHash<QString, QHash<QString, QString>>> future;
             };
             QMChronoMap<QStringList, std::variant<Single, Config>> items;
         };
@@ -73,22 +214,100 @@ namespace Core {
         mutable IconChange iconChange;
         mutable IconStorage iconStorage;
 
+        struct IconConfigCache {
+            QDateTime lastModified;
+            qint64 size;
+            QHash<QString, QHash<QString, QString>> icons;
+        };
+        mutable QHash<QString, IconConfigCache> iconConfigCache; // parsed files by path
+
+        QHash<QString, QSharedPointer<const ActionIconBundle>> iconBundles; // by file name
+
+        // Icons shared by file, the vector ones are replaced by pixmaps rasterized to the cache
+        // directory in the thread pool once they are ready
+        mutable QHash<QString, QIcon> iconCache;
+        QString iconCacheDirectory;
+
+        QIcon cachedIcon(const QString &fileName) const;
+        void rasterizeIcon(const QString &fileName) const;
+        QIcon bundledIcon(const QString &reference) const;
+
+        // Built on the first search, then kept up to date until the language changes
+        mutable QScopedPointer<ActionSearchIndex> searchIndex;
+
+        static QStringList searchTexts(const ActionObjectInfo &info);
+        void flushSearchIndex() const;
+
+        // Translations cached ahead of use on a worker thread whenever the language changes
+        bool translationPrefill = false;
+        void prefillTranslations() const;
+        void languageChanged();
+
         ActionDomain::ShortcutsFamily overriddenShortcuts;
         ActionDomain::IconFamily overriddenIcons;
 
+        enum StandaloneProperty {
+            TextProperty,
+            IconProperty,
+        };
+        mutable QHash<const QMetaObject *, int> standaloneProperties[2]; // writable index or -1
+        QMetaProperty standaloneProperty(QObject *obj, StandaloneProperty which) const;
+
         QScopedPointer<QWidgetAction> sharedStretchWidgetAction;
         QScopedPointer<ActionItem> sharedMenuItem;
 
         void flushIcons() const;
 
-        bool setLayouts_helper(const QList<ActionLayout> &layouts) const;
+        bool setLayouts_helper(const QList<ActionLayout> &layouts,
+                               const QList<QVector<int>> *menuReferences = nullptr) const;
+
+        // Populate the submenus on their first show
+        bool lazyMenuPopulation = false;
+
+        // Shared by a buildLayouts() call and the submenus it leaves to populate later
+        struct BuildState {
+            QSharedPointer<const ActionLayoutPlan> plan;
+
+            // Indexed by the slots of the plan, the items and menus may be deleted before a
+            // deferred submenu is shown
+            QVector<QPointer<ActionItem>> items;
+            QVector<QPointer<QMenu>> autoCreatedStandaloneMenus;
+            QVector<int> standaloneLayouts; // instruction of the actual layout
+
+            // Creates the menus of the shared menu item
+            ActionItem::MenuFactory menuFactory;
+        };
+
+        // State of a build pass, the actions of the containers are collected first and then
+        // reconciled with the installed ones
+        struct BuildContext {
+            QSharedPointer<BuildState> state;
+            ActionItem *sharedMenuItem = nullptr;
+            QHash<QWidget *, int> lastMenuItems;
+
+            // Menus and separators of the last build, reused in the same containers
+            QHash<QPair<QWidget *, QString>, QList<QPointer<QMenu>>> oldMenus;
+            QHash<QWidget *, QList<QAction *>> oldSeparators;
+
+            // Actions installed by the last build, the others belong to the application
+            QHash<QWidget *, QSet<QAction *>> installedActions;
+
+            QVector<QWidget *> containers;
+            QHash<QWidget *, QList<QAction *>> containerActions;
+            ActionDomain::BuildStatistics statistics;
+
+            QMenu *requestMenu(ActionItem *item, QWidget *parent, const QString &id);
+            QAction *requestSeparator(QWidget *parent);
+            void addContainer(QWidget *w);
+            void addAction(QWidget *w, QAction *action);
+            void removeLastAction(QWidget *w);
+            void commit();
+        };
 
-        void buildLayoutsRecursively(
-            const ActionLayout &layout, QWidget *parent,
-            const QHash<QString, QPair<ActionItem *, ActionObjectInfo>> &itemMap,
-            QHash<QWidget *, int> &lastMenuItems,
-            QHash<QString, QMenu *> &autoCreatedStandaloneMenus,
-            QHash<QString, ActionLayout> &standaloneLayouts) const;
+        void buildLayoutsRecursively(int index, QWidget *parent, BuildContext &ctx) const;
+        void buildChildLayouts(int index, QWidget *parent, BuildContext &ctx) const;
+        void deferMenu(QMenu *menu, int index, BuildContext &ctx) const;
+        void populateMenu(QMenu *menu, int index, const QSharedPointer<BuildState> &state) const;
     };
 
 }
@@ -2,11 +2,121 @@
 #include "actionextension_p.h"
 
 #include <QtCore/QCoreApplication>
+#include <QtCore/QReadWriteLock>
+#include <QtCore/QThread>
 
 #include <QMCore/qmcoreappextension.h>
 
 namespace Core {
 
+    // Translations by context and source, the translators are walked once per string until the
+    // application's language changes
+    class ActionTranslationCache {
+    public:
+        enum Context {
+            Text,
+            CommandClass,
+            Category,
+        };
+
+        QString translate(Context context, const QByteArray &source, bool *ok) {
+            static const char *const contextNames[] = {
+                "ChorusKit::ActionText",
+                "ChorusKit::ActionCommandClass",
+                "ChorusKit::ActionCategory",
+            };
+
+            // Not cached until the language changes can be watched
+            if (!watch())
+                return QMCoreAppExtension::translate(contextNames[context], source, nullptr, -1,
+                                                     ok);
+
+            quint64 gen;
+            {
+                QReadLocker locker(&lock);
+                const auto &map = translations[context];
+                if (auto it = map.constFind(source); it != map.cend()) {
+                    if (ok)
+                        *ok = it->ok;
+                    return it->text;
+                }
+                gen = generation;
+            }
+
+            bool translated = false;
+            auto text = QMCoreAppExtension::translate(contextNames[context], source, nullptr, -1,
+                                                      &translated);
+            {
+                // Dropped if the translators changed meanwhile
+                QWriteLocker locker(&lock);
+                if (gen == generation)
+                    translations[context].insert(source, {text, translated});
+            }
+            if (ok)
+                *ok = translated;
+            return text;
+        }
+
+        void clear() {
+            QWriteLocker locker(&lock);
+            for (auto &map : translations) {
+                map.clear();
+            }
+            generation++;
+        }
+
+    private:
+        struct Translation {
+            QString text;
+            bool ok;
+        };
+        QReadWriteLock lock;
+        QHash<QByteArray, Translation> translations[3];
+        quint64 generation = 0;
+        QAtomicInt watching;
+
+        class Watcher : public QObject {
+        public:
+            Watcher(ActionTranslationCache *cache, QCoreApplication *app)
+                : QObject(app), cache(cache) {
+                app->installEventFilter(this);
+            }
+            ~Watcher() {
+                cache->watching.storeRelease(0);
+                cache->clear();
+            }
+
+        protected:
+            bool eventFilter(QObject *obj, QEvent *event) override {
+                if (event->type() == QEvent::LanguageChange && obj == parent())
+                    cache->clear();
+                return QObject::eventFilter(obj, event);
+            }
+
+        private:
+            ActionTranslationCache *cache;
+        };
+
+        bool watch() {
+            if (watching.loadAcquire())
+                return true;
+
+            // The watcher belongs to the application's thread
+            auto app = QCoreApplication::instance();
+            if (!app || QThread::currentThread() != app->thread())
+                return false;
+            if (watching.testAndSetOrdered(0, 1))
+                new Watcher(this, app);
+            return true;
+        }
+    };
+
+    Q_GLOBAL_STATIC(ActionTranslationCache, translationCache)
+
+    bool watchActionTranslations() {
+        return translationCache->watch();
+    }
+
     QString ActionObjectInfo::id() const {
         if (!ext)
             return {};
@@ -50,17 +160,15 @@ namespace Core {
     }
 
     QString ActionObjectInfo::translatedText(const QByteArray &text, bool *ok) {
-        return QMCoreAppExtension::translate("ChorusKit::ActionText", text, nullptr, -1, ok);
+        return translationCache->translate(ActionTranslationCache::Text, text, ok);
     }
 
     QString ActionObjectInfo::translatedCommandClass(const QByteArray &commandClass, bool *ok) {
-        return QMCoreAppExtension::translate("ChorusKit::ActionCommandClass", commandClass, nullptr,
-                                             -1, ok);
+        return translationCache->translate(ActionTranslationCache::CommandClass, commandClass, ok);
     }
 
     QString ActionObjectInfo::translatedCategory(const QByteArray &category, bool *ok) {
-        return QMCoreAppExtension::translate("ChorusKit::ActionCategory", category, nullptr, -1,
-                                             ok);
+        return translationCache->translate(ActionTranslationCache::Category, category, ok);
     }
 
     QString ActionLayoutInfo::id() const {
@@ -51,6 +51,10 @@ namespace Core {
         }
     };
 
+    // Installs the watcher that drops the cached translations when the language changes, only
+    // possible on the application's thread. The cache keeps nothing until it is installed.
+    bool watchActionTranslations();
+
 }
 
 #endif // ACTIONEXTENSION_P_H
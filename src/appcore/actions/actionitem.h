@@ -60,6 +60,7 @@ namespace Core {
         QScopedPointer<ActionItemPrivate> d_ptr;
 
         friend class ActionDomain;
+        friend class ActionDomainPrivate;
     };
 
     inline bool ActionItem::isAction() const {
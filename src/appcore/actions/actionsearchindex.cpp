@@ -0,0 +1,274 @@
+#include "actionsearchindex.h"
+#include "actionsearchindex_p.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace Core {
+
+    static inline quint64 trigramKey(const QChar *s) {
+        return (quint64(s[0].unicode()) << 32) | (quint64(s[1].unicode()) << 16) |
+               quint64(s[2].unicode());
+    }
+
+    ActionSearchIndexPrivate::ActionSearchIndexPrivate() : q_ptr(nullptr), removedCount(0) {
+    }
+    ActionSearchIndexPrivate::~ActionSearchIndexPrivate() = default;
+
+    void ActionSearchIndexPrivate::init() {
+    }
+
+    void ActionSearchIndexPrivate::addPostings(int index) {
+        // The entry is the last one, so a posting list holds it once if its last item is checked
+        auto add = [index](QVector<int> &list) {
+            if (list.isEmpty() || list.last() != index)
+                list.append(index);
+        };
+        for (const auto &text : std::as_const(entries.at(index).texts)) {
+            for (int i = 0; i + 2 < text.size(); ++i) {
+                add(trigrams[trigramKey(text.constData() + i)]);
+            }
+            for (int i = 0; i < text.size(); ++i) {
+                if (text.at(i) != QLatin1Char(' ') && (i == 0 || text.at(i - 1) == QLatin1Char(' ')))
+                    add(initials[text.at(i)]);
+            }
+        }
+    }
+
+    void ActionSearchIndexPrivate::compact() {
+        QVector<Entry> alive;
+        alive.reserve(entries.size() - removedCount);
+        for (const auto &entry : std::as_const(entries)) {
+            if (!entry.removed)
+                alive.append(entry);
+        }
+        entries.swap(alive);
+        indexes.clear();
+        trigrams.clear();
+        initials.clear();
+        removedCount = 0;
+        for (int i = 0; i < entries.size(); ++i) {
+            indexes.insert(entries.at(i).id, i);
+            addPostings(i);
+        }
+    }
+
+    // Case folded words separated by single spaces, mnemonics and punctuation dropped and camel
+    // case split, so that "&Open File..." and "OpenFileCommand" both have the words "open file"
+    QString ActionSearchIndexPrivate::normalize(const QString &s) {
+        QString res;
+        res.reserve(s.size());
+        QChar prev;
+        for (const auto &c : s) {
+            if (c == QLatin1Char('&'))
+                continue;
+            if (!c.isLetterOrNumber()) {
+                if (!res.isEmpty() && !res.endsWith(QLatin1Char(' ')))
+                    res += QLatin1Char(' ');
+            } else {
+                if (c.isUpper() && prev.isLower())
+                    res += QLatin1Char(' ');
+                res += c;
+            }
+            prev = c;
+        }
+        if (res.endsWith(QLatin1Char(' ')))
+            res.chop(1);
+        return res.toCaseFolded();
+    }
+
+    quint64 ActionSearchIndexPrivate::characterMask(const QString &s) {
+        quint64 mask = 0;
+        for (const auto &c : s) {
+            if (c != QLatin1Char(' '))
+                mask |= quint64(1) << (c.unicode() % 64);
+        }
+        return mask;
+    }
+
+    // Substring matches rank above fuzzy ones, earlier and word aligned matches in shorter texts
+    // rank higher. Returns -1 if the text doesn't match.
+    int ActionSearchIndexPrivate::score(const QString &pattern, const QString &text) {
+        if (text.isEmpty())
+            return -1;
+
+        if (int pos = text.indexOf(pattern); pos >= 0) {
+            int res = 1000 + pattern.size() * 10 - qMin(text.size() - pattern.size(), 100);
+            if (pos == 0) {
+                res += 300;
+            } else if (text.at(pos - 1) == QLatin1Char(' ')) {
+                res += 200;
+            }
+            return res;
+        }
+
+        // The pattern characters in order, the first one starting a word
+        int res = 0;
+        int last = -1;
+        int j = 0;
+        for (int i = 0; i < text.size(); ++i) {
+            while (j < pattern.size() && pattern.at(j) == QLatin1Char(' '))
+                ++j;
+            if (j == pattern.size())
+                break;
+            if (text.at(i) != pattern.at(j))
+                continue;
+
+            bool wordStart = i == 0 || text.at(i - 1) == QLatin1Char(' ');
+            if (last < 0) {
+                if (!wordStart)
+                    continue;
+            } else if (i == last + 1) {
+                res += 15;
+            } else {
+                res -= qMin(i - last - 1, 10);
+            }
+            res += wordStart ? 30 : 10;
+            last = i;
+            ++j;
+        }
+        while (j < pattern.size() && pattern.at(j) == QLatin1Char(' '))
+            ++j;
+        if (j < pattern.size())
+            return -1;
+        return qBound(0, res - text.size() / 4, 999);
+    }
+
+    ActionSearchIndex::ActionSearchIndex() : ActionSearchIndex(*new ActionSearchIndexPrivate()) {
+    }
+    ActionSearchIndex::~ActionSearchIndex() = default;
+
+    void ActionSearchIndex::insert(const QString &id, const QStringList &texts) {
+        Q_D(ActionSearchIndex);
+        remove(id);
+
+        ActionSearchIndexPrivate::Entry entry{id, {}, 0, false};
+        for (const auto &text : texts) {
+            auto normalized = ActionSearchIndexPrivate::normalize(text);
+            entry.mask |= ActionSearchIndexPrivate::characterMask(normalized);
+            entry.texts.append(normalized);
+        }
+
+        int index = d->entries.size();
+        d->entries.append(entry);
+        d->indexes.insert(id, index);
+        d->addPostings(index);
+    }
+    void ActionSearchIndex::remove(const QString &id) {
+        Q_D(ActionSearchIndex);
+        auto it = d->indexes.find(id);
+        if (it == d->indexes.end())
+            return;
+
+        auto &entry = d->entries[it.value()];
+        entry.removed = true;
+        entry.texts.clear();
+        d->indexes.erase(it);
+        d->removedCount++;
+
+        // Rebuild the postings once most of them are stale
+        if (d->removedCount > 64 && d->removedCount * 2 > d->entries.size())
+            d->compact();
+    }
+    void ActionSearchIndex::clear() {
+        Q_D(ActionSearchIndex);
+        d->entries.clear();
+        d->indexes.clear();
+        d->trigrams.clear();
+        d->initials.clear();
+        d->removedCount = 0;
+    }
+
+    bool ActionSearchIndex::contains(const QString &id) const {
+        Q_D(const ActionSearchIndex);
+        return d->indexes.contains(id);
+    }
+    int ActionSearchIndex::size() const {
+        Q_D(const ActionSearchIndex);
+        return d->indexes.size();
+    }
+
+    QList<ActionSearchIndex::Match> ActionSearchIndex::search(const QString &pattern,
+                                                              int limit) const {
+        Q_D(const ActionSearchIndex);
+        auto p = ActionSearchIndexPrivate::normalize(pattern);
+        if (p.isEmpty() || limit <= 0)
+            return {};
+
+        // Substring candidates contain all trigrams of the pattern
+        QVector<int> candidates;
+        if (p.size() >= 3) {
+            QVector<const QVector<int> *> lists;
+            for (int i = 0; i + 2 < p.size(); ++i) {
+                auto it = d->trigrams.constFind(trigramKey(p.constData() + i));
+                if (it == d->trigrams.cend()) {
+                    lists.clear();
+                    break;
+                }
+                lists.append(&it.value());
+            }
+            std::sort(lists.begin(), lists.end(),
+                      [](const QVector<int> *a, const QVector<int> *b) {
+                          return a->size() < b->size(); //
+                      });
+            if (!lists.isEmpty()) {
+                candidates = *lists.front();
+                QVector<int> tmp;
+                for (int i = 1; i < lists.size() && !candidates.isEmpty(); ++i) {
+                    tmp.clear();
+                    std::set_intersection(candidates.begin(), candidates.end(),
+                                          lists.at(i)->begin(), lists.at(i)->end(),
+                                          std::back_inserter(tmp));
+                    candidates.swap(tmp);
+                }
+            }
+        }
+
+        // Fuzzy candidates have a word starting with the first character
+        if (auto it = d->initials.constFind(p.at(0)); it != d->initials.cend()) {
+            QVector<int> merged;
+            merged.reserve(candidates.size() + it->size());
+            std::set_union(candidates.begin(), candidates.end(), it->begin(), it->end(),
+                           std::back_inserter(merged));
+            candidates.swap(merged);
+        }
+
+        auto mask = ActionSearchIndexPrivate::characterMask(p);
+        QVector<QPair<int, int>> scored; // score, entry
+        for (const auto &index : std::as_const(candidates)) {
+            const auto &entry = d->entries.at(index);
+            if (entry.removed || (entry.mask & mask) != mask)
+                continue;
+
+            int best = -1;
+            for (int i = 0; i < entry.texts.size(); ++i) {
+                int s = ActionSearchIndexPrivate::score(p, entry.texts.at(i));
+                if (s > 0 && i > 0)
+                    s = qMax(0, s - 100);
+                best = qMax(best, s);
+            }
+            if (best >= 0)
+                scored.append({best, index});
+        }
+
+        int count = qMin(limit, scored.size());
+        std::partial_sort(scored.begin(), scored.begin() + count, scored.end(),
+                          [](const QPair<int, int> &a, const QPair<int, int> &b) {
+                              return a.first != b.first ? a.first > b.first : a.second < b.second;
+                          });
+
+        QList<Match> res;
+        res.reserve(count);
+        for (int i = 0; i < count; ++i) {
+            res.append({d->entries.at(scored.at(i).second).id, scored.at(i).first});
+        }
+        return res;
+    }
+
+    ActionSearchIndex::ActionSearchIndex(ActionSearchIndexPrivate &d) : d_ptr(&d) {
+        d.q_ptr = this;
+
+        d.init();
+    }
+
+}
@@ -0,0 +1,45 @@
+#ifndef ACTIONSEARCHINDEX_H
+#define ACTIONSEARCHINDEX_H
+
+#include <QScopedPointer>
+#include <QStringList>
+
+#include <CoreApi/ckappcoreglobal.h>
+
+namespace Core {
+
+    class ActionSearchIndexPrivate;
+
+    class CKAPPCORE_EXPORT ActionSearchIndex {
+        Q_DECLARE_PRIVATE(ActionSearchIndex)
+    public:
+        ActionSearchIndex();
+        ~ActionSearchIndex();
+
+        struct Match {
+            QString id;
+            int score;
+        };
+
+    public:
+        // The first text is the main one, the others score a little lower
+        void insert(const QString &id, const QStringList &texts);
+        void remove(const QString &id);
+        void clear();
+
+        bool contains(const QString &id) const;
+        int size() const;
+
+        QList<Match> search(const QString &pattern, int limit = 50) const;
+
+    protected:
+        ActionSearchIndex(ActionSearchIndexPrivate &d);
+
+        QScopedPointer<ActionSearchIndexPrivate> d_ptr;
+
+        Q_DISABLE_COPY(ActionSearchIndex)
+    };
+
+}
+
+#endif // ACTIONSEARCHINDEX_H
@@ -0,0 +1,45 @@
+#ifndef ACTIONSEARCHINDEX_P_H
+#define ACTIONSEARCHINDEX_P_H
+
+#include <QHash>
+#include <QVector>
+
+#include <CoreApi/actionsearchindex.h>
+
+namespace Core {
+
+    class ActionSearchIndexPrivate {
+        Q_DECLARE_PUBLIC(ActionSearchIndex)
+    public:
+        ActionSearchIndexPrivate();
+        virtual ~ActionSearchIndexPrivate();
+
+        void init();
+
+        ActionSearchIndex *q_ptr;
+
+        struct Entry {
+            QString id;
+            QStringList texts; // normalized
+            quint64 mask;      // characters contained
+            bool removed;
+        };
+        QVector<Entry> entries;
+        QHash<QString, int> indexes; // id -> entry
+        int removedCount;
+
+        // Entry indexes in ascending order, removed entries are skipped until compacted
+        QHash<quint64, QVector<int>> trigrams;
+        QHash<QChar, QVector<int>> initials; // first character of each word
+
+        void addPostings(int index);
+        void compact();
+
+        static QString normalize(const QString &s);
+        static quint64 characterMask(const QString &s);
+        static int score(const QString &pattern, const QString &text);
+    };
+
+}
+
+#endif // ACTIONSEARCHINDEX_P_H
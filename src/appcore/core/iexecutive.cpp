@@ -1,6 +1,8 @@
 #include "iexecutive.h"
 #include "iexecutive_p.h"
 
+#include "iloader.h"
+
 namespace Core {
 
     static const int DELAYED_INITIALIZE_INTERVAL = 5; // ms
@@ -166,6 +168,13 @@ namespace Core {
         if (d->state >= Starting)
             return;
 
+        // The executive may have been created before the loader
+        if (!parentPool()) {
+            auto loader = ILoader::instance();
+            Q_ASSERT_X(loader, "IExecutive::loadImpl", "no loader to resolve global services");
+            setParentPool(loader);
+        }
+
         for (auto &addOn : qAsConst(d->addOns)) {
             auto d1 = addOn->d_func();
             addOn->d_func()->host = this;
@@ -182,6 +191,11 @@ namespace Core {
 
     IExecutive::IExecutive(IExecutivePrivate &d, QObject *parent) : ObjectPool(d, parent) {
         d.init();
+
+        // Global services are resolved through the loader, set again when loading if it doesn't
+        // exist yet
+        if (auto loader = ILoader::instance())
+            setParentPool(loader);
     }
 
 }
@@ -68,17 +68,37 @@ namespace Core {
         qDebug().noquote() << "ILoader: initialize at"
                            << startTime().toString("yyyy/MM/dd hh:mm:ss:zzz");
 
-        connect(this, &ILoader::objectAdded, this, [&](const QString &id, QObject *obj) {
-            qDebug().nospace() << "ILoader: object added (" << id << ", " << obj << ")"; //
-        });
+        // Opt-in pool statistics, dumped at shutdown
+        if (qEnvironmentVariableIntValue("CHORUSKIT_OBJECTPOOL_STATISTICS")) {
+            setStatisticsEnabled(true);
+        }
+
+        connect(this, &ILoader::objectsAdded, this,
+                [&](const QList<QPair<QString, QObject *>> &objs) {
+                    qDebug().nospace() << "ILoader: objects added " << objs; //
+                });
 
-        connect(this, &ILoader::aboutToRemoveObject, this, [&](const QString &id, QObject *obj) {
-            qDebug().nospace() << "ILoader: object to remove (" << id << ", " << obj << ")"; //
-        });
+        connect(this, &ILoader::aboutToRemoveObjects, this,
+                [&](const QList<QPair<QString, QObject *>> &objs) {
+                    qDebug().nospace() << "ILoader: objects to remove " << objs; //
+                });
     }
 
     ILoader::~ILoader() {
         Q_D(ILoader);
+        if (auto factories = unusedFactories(); !factories.isEmpty()) {
+            auto dbg = qDebug().nospace();
+            dbg << "ILoader: " << factories.size() << " factories never used";
+            for (const auto &item : qAsConst(factories)) {
+                dbg << " (" << item.first << ", " << item.second->className() << ")";
+            }
+        }
+
+        if (statisticsEnabled()) {
+            qDebug().noquote() << "ILoader: object pool statistics"
+                               << QJsonDocument(statistics().toJson()).toJson(QJsonDocument::Compact);
+        }
+
         if (d->settingsNeedWrite) {
             writeSettings();
         }
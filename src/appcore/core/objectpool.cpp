@@ -1,8 +1,20 @@
 #include "objectpool.h"
 #include "objectpool_p.h"
 
+#include <algorithm>
+#include <atomic>
+
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QGlobalStatic>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QScopeGuard>
+#include <QSet>
 #include <QMetaMethod>
+#include <QPointer>
+#include <QThread>
+#include <QVarLengthArray>
 
 #define DISABLE_WARNING_OBJECTS_LEFT
 
@@ -10,29 +22,828 @@ namespace Core {
 
 #define myWarning(func) (qWarning().nospace() << "Core::ObjectPool::" << (func) << "():").space()
 
-    ObjectPoolPrivate::ObjectPoolPrivate() {
+    class ObjectPoolIdData {
+    public:
+        QString name;
+        mutable QAtomicInt refs;
+    };
+
+    // Atoms are looked up under the read lock and erased under the write lock by the thread that
+    // releases the last reference, a dying atom is never referenced again
+    struct ObjectPoolIdTable {
+        QReadWriteLock lock;
+        QHash<QString, ObjectPoolIdData *> atoms;
+    };
+
+    Q_GLOBAL_STATIC(ObjectPoolIdTable, idTable)
+
+    // Takes a reference unless the atom is dying
+    static bool tryRefAtom(const ObjectPoolIdData *data) {
+        int refs = data->refs.loadAcquire();
+        while (refs > 0) {
+            if (data->refs.testAndSetOrdered(refs, refs + 1, refs))
+                return true;
+        }
+        return false;
+    }
+
+    ObjectPool::Id::Id(const QString &name) : m_data(nullptr) {
+        if (name.isEmpty())
+            return;
+
+        bool ok;
+        *this = lookup(name, &ok);
+        if (ok)
+            return;
+
+        auto table = idTable();
+        QWriteLocker locker(&table->lock);
+        auto &atom = table->atoms[name];
+        if (!atom || !tryRefAtom(atom)) {
+            // A dying atom is left to the releasing thread, which finds it replaced
+            atom = new ObjectPoolIdData{name, 1};
+        }
+        m_data = atom;
+    }
+
+    ObjectPool::Id::Id(const char *name) : Id(QString::fromUtf8(name)) {
+    }
+
+    ObjectPool::Id ObjectPool::Id::lookup(const QString &name, bool *ok) {
+        Id res;
+        bool found = true;
+        if (!name.isEmpty()) {
+            auto table = idTable();
+            QReadLocker locker(&table->lock);
+            auto atom = table->atoms.value(name, nullptr);
+            found = atom && tryRefAtom(atom);
+            if (found)
+                res.m_data = atom;
+        }
+        if (ok)
+            *ok = found;
+        return res;
+    }
+
+    int ObjectPool::Id::atomCount() {
+        auto table = idTable();
+        if (!table)
+            return 0;
+        QReadLocker locker(&table->lock);
+        return table->atoms.size();
     }
 
-    ObjectPoolPrivate::~ObjectPoolPrivate() = default;
+    void ObjectPool::Id::ref(const ObjectPoolIdData *data) {
+        data->refs.ref();
+    }
+
+    void ObjectPool::Id::deref(const ObjectPoolIdData *data) {
+        if (data->refs.deref())
+            return;
+
+        // Static ids may be destroyed after the table, their atoms are left
+        auto table = idTable();
+        if (!table)
+            return;
+        {
+            QWriteLocker locker(&table->lock);
+            auto it = table->atoms.find(data->name);
+            if (it != table->atoms.end() && it.value() == data) {
+                table->atoms.erase(it);
+            }
+        }
+        delete data;
+    }
+
+    QString ObjectPool::Id::toString() const {
+        return m_data ? m_data->name : QString();
+    }
+
+    // Lockers of the object list that measure the waiting and holding time if statistics are
+    // enabled, the flag is the only cost otherwise
+    class ListReadLocker {
+    public:
+        explicit inline ListReadLocker(const ObjectPoolPrivate *d) : m_lock(&d->objectListLock) {
+            if (Q_LIKELY(!d->statisticsEnabled.loadRelaxed())) {
+                m_lock->lockForRead();
+                return;
+            }
+            QElapsedTimer timer;
+            timer.start();
+            m_lock->lockForRead();
+            d->recordLock(d->readLockCount, d->readLockWaitTime, d->maxReadLockWaitTime,
+                          timer.nsecsElapsed());
+        }
+        inline ~ListReadLocker() {
+            m_lock->unlock();
+        }
+
+    private:
+        QReadWriteLock *m_lock;
+
+        Q_DISABLE_COPY(ListReadLocker)
+    };
+
+    class ListWriteLocker {
+    public:
+        explicit inline ListWriteLocker(const ObjectPoolPrivate *d) : m_d(d) {
+            d->objectListLock.lockForWrite();
+            if (Q_UNLIKELY(d->statisticsEnabled.loadRelaxed())) {
+                m_timer.start();
+            }
+        }
+        inline ~ListWriteLocker() {
+            qint64 elapsed = m_timer.isValid() ? m_timer.nsecsElapsed() : -1;
+            m_d->objectListLock.unlock();
+            if (elapsed >= 0) {
+                m_d->recordLock(m_d->writeLockCount, m_d->writeLockHoldTime,
+                                m_d->maxWriteLockHoldTime, elapsed);
+            }
+        }
+
+    private:
+        const ObjectPoolPrivate *m_d;
+        QElapsedTimer m_timer;
+
+        Q_DISABLE_COPY(ListWriteLocker)
+    };
+
+    ObjectPoolPrivate::ObjectPoolPrivate() : chainGeneration(1) {
+    }
+
+    ObjectPoolPrivate::~ObjectPoolPrivate() {
+        if (auto data = snapshot.loadAcquire())
+            releaseSnapshot(data);
+        for (const auto &data : std::as_const(retiredSnapshots)) {
+            releaseSnapshot(data);
+        }
+
+        auto node = postedHead.fetchAndStoreAcquire(nullptr);
+        while (node) {
+            auto next = node->next;
+            delete node;
+            node = next;
+        }
+    }
 
     void ObjectPoolPrivate::init() {
     }
 
-    void ObjectPoolPrivate::objectAdded(const QString &id, QObject *obj) {
-        Q_Q(ObjectPool);
-        Q_EMIT q->objectAdded(id, obj);
+    void ObjectPoolPrivate::indexObject(QObject *obj, const QMetaObject *metaObject) {
+        for (auto mo = metaObject; mo; mo = mo->superClass()) {
+            typeIndex[mo].append(obj);
+        }
+        for (auto it = interfaceIndex.begin(); it != interfaceIndex.end(); ++it) {
+            if (obj->qt_metacast(it.key())) {
+                it->append(obj);
+            }
+        }
+    }
+
+    void ObjectPoolPrivate::unindexObject(QObject *obj, const QMetaObject *metaObject) {
+        for (auto mo = metaObject; mo; mo = mo->superClass()) {
+            auto it = typeIndex.find(mo);
+            if (it == typeIndex.end())
+                continue;
+            it->remove(obj);
+            if (it->isEmpty()) {
+                typeIndex.erase(it);
+            }
+        }
+        for (auto it = interfaceIndex.begin(); it != interfaceIndex.end(); ++it) {
+            it->remove(obj);
+        }
+    }
+
+    const QMChronoSet<QObject *> &ObjectPoolPrivate::interfaceObjects(const char *iid) const {
+        // Interfaces are not listed in the meta object, so the set of objects implementing one is
+        // collected when it's queried the first time and then kept up to date by indexObject().
+        // Keys are the IID literals, the same IID spelled at different addresses only results in
+        // an extra entry.
+        auto it = interfaceIndex.find(iid);
+        if (it == interfaceIndex.end()) {
+            it = interfaceIndex.insert(iid, {});
+            for (const auto &obj : objects) {
+                if (obj->qt_metacast(iid)) {
+                    it->append(obj);
+                }
+            }
+            snapshotVersion.ref(); // the next snapshot gets the index
+        }
+        return it.value();
+    }
+
+    bool ObjectPoolPrivate::insertObject(const ObjectPool::Id &id, QObject *obj) {
+        // An object has one id and one handle slot, adding it under another id would leave the
+        // first slot pointing to it after its removal
+        if (auto it = objectIndexes.find(obj); it != objectIndexes.end()) {
+            myWarning("addObject") << "trying to add duplicated object:" << id.toString() << obj
+                                   << "already added as" << it->id.toString();
+            return false;
+        }
+        auto &set = objectMap[id];
+        if (set.isEmpty()) {
+            idNames.insert(id.toString(), id);
+        }
+        set.append(obj);
+
+        // Add to list
+        auto it = objects.insert(objects.end(), obj);
+
+        // Add to index
+        auto mo = obj->metaObject();
+        objectIndexes.insert(obj, {id, it, mo, allocateSlot(obj)});
+        indexObject(obj, mo);
+        snapshotVersion.ref();
+        return true;
+    }
+
+    const QMChronoSet<QObject *> *ObjectPoolPrivate::namedObjects(const QString &name) const {
+        auto it = idNames.find(name);
+        if (it == idNames.end())
+            return nullptr;
+        auto it2 = objectMap.find(it.value());
+        return it2 != objectMap.end() ? &it2.value() : nullptr;
+    }
+
+    ObjectPool::Id ObjectPoolPrivate::idOf(const QString &name, bool *ok) const {
+        // Ids only known to pending factories are not listed, the global table has them
+        if (factoryCount.loadAcquire() != 0)
+            return ObjectPool::Id::lookup(name, ok);
+
+        ListReadLocker locker(this);
+        auto it = idNames.find(name);
+        *ok = it != idNames.end();
+        return *ok ? it.value() : ObjectPool::Id();
+    }
+
+    quint32 ObjectPoolPrivate::allocateSlot(QObject *obj) {
+        quint32 index;
+        if (!freeHandleSlots.isEmpty()) {
+            index = freeHandleSlots.takeLast();
+        } else {
+            index = quint32(handleSlots.size());
+            handleSlots.append({nullptr, 1});
+        }
+        handleSlots[int(index)].obj = obj;
+
+        // Qt has no public hook to observe the destruction of arbitrary objects from one guard,
+        // so each object still gets its own connection, of the default type as before
         connect(obj, &QObject::destroyed, this, &ObjectPoolPrivate::_q_objectDestroyed);
+        return index;
+    }
+
+    void ObjectPoolPrivate::releaseSlot(quint32 index) {
+        auto &slot = handleSlots[int(index)];
+        disconnect(slot.obj, &QObject::destroyed, this, &ObjectPoolPrivate::_q_objectDestroyed);
+        slot.obj = nullptr;
+        if (++slot.generation == 0) {
+            slot.generation = 1; // 0 is reserved for null handles
+        }
+        freeHandleSlots.append(index);
+    }
+
+    bool ObjectPoolPrivate::eraseObject(QObject *obj) {
+        auto it = objectIndexes.find(obj);
+        if (it == objectIndexes.end()) {
+            return false;
+        }
+
+        // Remove from map
+        auto it2 = objectMap.find(it->id);
+        auto &set = it2.value();
+        set.remove(obj);
+        if (set.isEmpty()) {
+            objectMap.erase(it2);
+            idNames.remove(it->id.toString());
+        }
+
+        // Remove from list
+        objects.erase(it->it);
+
+        // Remove from type indexes
+        unindexObject(obj, it->metaObject);
+        snapshotVersion.ref();
+
+        // Invalidate handles
+        releaseSlot(it->slot);
+
+        // Remove from indexes
+        objectIndexes.erase(it);
+        return true;
+    }
+
+    void ObjectPoolPrivate::commitBatch(const QList<QPair<ObjectPool::Id, QObject *>> &additions,
+                                        const QList<QObject *> &removals,
+                                        const QList<ObjectPool::Id> &idRemovals) {
+        // Collect existing objects to remove
+        QList<QPair<ObjectPool::Id, QObject *>> objectsToRemove;
+        if (!removals.isEmpty() || !idRemovals.isEmpty()) {
+            ListReadLocker locker(this);
+            QSet<QObject *> visited;
+            for (const auto &obj : removals) {
+                auto it = objectIndexes.find(obj);
+                if (it == objectIndexes.end()) {
+                    myWarning("removeObject") << "obj does not exist:" << obj;
+                    continue;
+                }
+                if (visited.contains(obj))
+                    continue;
+                visited.insert(obj);
+                disconnect(obj, &QObject::destroyed, this, &ObjectPoolPrivate::_q_objectDestroyed);
+                objectsToRemove.append({it->id, obj});
+            }
+            for (const auto &id : idRemovals) {
+                auto it = objectMap.find(id);
+                if (it == objectMap.end())
+                    continue;
+                for (const auto &obj : it.value()) {
+                    if (visited.contains(obj))
+                        continue;
+                    visited.insert(obj);
+                    disconnect(obj, &QObject::destroyed, this,
+                               &ObjectPoolPrivate::_q_objectDestroyed);
+                    objectsToRemove.append({id, obj});
+                }
+            }
+        }
+
+        for (const auto &id : idRemovals) {
+            removeFactories(id);
+        }
+
+        if (!objectsToRemove.isEmpty()) {
+            aboutToRemoveObjects(objectsToRemove);
+        }
+
+        // Apply all changes under one lock
+        QList<QPair<ObjectPool::Id, QObject *>> addedObjects;
+        {
+            ListWriteLocker locker(this);
+            bool changed = false;
+            for (const auto &item : qAsConst(objectsToRemove)) {
+                changed |= eraseObject(item.second);
+            }
+            addedObjects.reserve(additions.size());
+            for (const auto &item : additions) {
+                if (insertObject(item.first, item.second)) {
+                    addedObjects.append(item);
+                }
+            }
+            if (changed || !addedObjects.isEmpty()) {
+                touch();
+            }
+        }
+
+        if (!addedObjects.isEmpty()) {
+            objectsAdded(addedObjects);
+        }
+    }
+
+    template <class Predicate>
+    int ObjectPoolPrivate::materializeFactories(Predicate predicate, bool firstOnly) const {
+        if (factoryCount.loadAcquire() == 0)
+            return 0;
+
+        // The factories are taken out under the lock and run after it's released, since they and
+        // the listeners of the added objects may run arbitrary code. They stay listed as in flight
+        // until their objects are added, so that a concurrent lookup waits for them rather than
+        // missing the objects. A factory querying the pool again only skips itself.
+        const auto thread = QThread::currentThreadId();
+        QVarLengthArray<std::list<Factory>::iterator, 4> matched;
+        int waited = 0;
+        {
+            QMutexLocker locker(&factoryLock);
+            auto countInFlight = [&]() {
+                return int(std::count_if(materializing.begin(), materializing.end(),
+                                         [&](const Factory &f) {
+                                             return f.thread != thread && predicate(f);
+                                         }));
+            };
+            while (int n = countInFlight()) {
+                waited = qMax(waited, n);
+                factoryDone.wait(&factoryLock);
+            }
+            if (firstOnly && waited)
+                return waited;
+
+            for (auto it = factories.begin(); it != factories.end();) {
+                if (!predicate(*it)) {
+                    ++it;
+                    continue;
+                }
+                auto next = std::next(it);
+                it->thread = thread;
+                materializing.splice(materializing.end(), factories, it);
+                matched.append(it);
+                it = next;
+                if (firstOnly)
+                    break;
+            }
+        }
+
+        int cnt = waited;
+        for (const auto &it : std::as_const(matched)) {
+            // Only this thread erases the entry, the others just read it under the lock
+            auto obj = it->create();
+            if (!obj) {
+                myWarning("addFactory") << "factory returns null object:" << it->id.toString();
+            } else {
+                q_ptr->addObject(it->id, obj);
+                cnt++;
+            }
+
+            QMutexLocker locker(&factoryLock);
+            materializing.erase(it);
+            factoryCount.deref();
+            factoryDone.wakeAll();
+        }
+        return cnt;
+    }
+
+    void ObjectPoolPrivate::removeFactories(const ObjectPool::Id &id) {
+        if (factoryCount.loadAcquire() == 0)
+            return;
+
+        QMutexLocker locker(&factoryLock);
+        for (auto it = factories.begin(); it != factories.end();) {
+            if (it->id == id) {
+                it = factories.erase(it);
+                factoryCount.deref();
+                continue;
+            }
+            ++it;
+        }
+    }
+
+    void ObjectPoolPrivate::pushPosted(PostedNode *node) {
+        PostedNode *head;
+        do {
+            head = postedHead.loadRelaxed();
+            node->next = head;
+        } while (!postedHead.testAndSetRelease(head, node));
+
+        // Only the producer that finds the stack empty schedules a drain, the drain empties the
+        // stack before adding so that later producers schedule another one
+        if (!head) {
+            QMetaObject::invokeMethod(
+                q_ptr, [this]() { drainPosted(); }, Qt::QueuedConnection);
+        }
+    }
+
+    void ObjectPoolPrivate::drainPosted() {
+        auto node = postedHead.fetchAndStoreAcquire(nullptr);
+        if (!node)
+            return;
+
+        // Reverse to the posting order
+        PostedNode *list = nullptr;
+        while (node) {
+            auto next = node->next;
+            node->next = list;
+            list = node;
+            node = next;
+        }
+
+        ObjectPool::Batch batch(q_ptr);
+        while (list) {
+            auto next = list->next;
+            batch.addObject(list->id, list->obj);
+            delete list;
+            list = next;
+        }
+    }
+
+    ObjectPoolSnapshotData *ObjectPoolPrivate::acquireSnapshot() const {
+        // A snapshot loaded here is released by a publisher only after the reader count dropped
+        snapshotReaders.ref();
+        auto data = snapshot.loadAcquire();
+        if (data)
+            data->refs.ref();
+        snapshotReaders.deref();
+        return data;
+    }
+
+    ObjectPoolSnapshotData *ObjectPoolPrivate::currentSnapshot() const {
+        auto data = acquireSnapshot();
+        if (data && data->version == snapshotVersion.loadAcquire())
+            return data;
+        if (data)
+            releaseSnapshot(data);
+
+        // Rebuilt once by the first reader after a modification, the others wait for it
+        QMutexLocker locker(&snapshotLock);
+        data = snapshot.loadAcquire();
+        if (data && data->version == snapshotVersion.loadAcquire()) {
+            data->refs.ref();
+            return data;
+        }
+        data = new ObjectPoolSnapshotData();
+        {
+            ListReadLocker listLocker(this);
+            buildSnapshot(*data);
+        }
+        data->refs.storeRelaxed(2); // the pool and the caller
+        publishSnapshot(data);
+        return data;
+    }
+
+    void ObjectPoolPrivate::buildSnapshot(ObjectPoolSnapshotData &data) const {
+        // Modifications bump the version under the write lock
+        data.version = snapshotVersion.loadRelaxed();
+        data.objects.reserve(int(objects.size()));
+        for (const auto &obj : objects) {
+            data.objects.append(obj);
+        }
+        data.names = idNames;
+
+        auto copyIndex = [](auto &to, const auto &from) {
+            to.reserve(from.size());
+            for (auto it = from.begin(); it != from.end(); ++it) {
+                auto &vec = to[it.key()];
+                vec.reserve(it->size());
+                for (const auto &obj : it.value()) {
+                    vec.append(obj);
+                }
+            }
+        };
+        copyIndex(data.objectMap, objectMap);
+        copyIndex(data.typeIndex, typeIndex);
+        copyIndex(data.interfaceIndex, interfaceIndex);
+    }
+
+    void ObjectPoolPrivate::publishSnapshot(ObjectPoolSnapshotData *data) const {
+        // Called with the snapshot lock held. The exchange and the check of the reader count are
+        // both ordered, so a reader counted out has either taken its reference to the old
+        // snapshot already or will load the new one.
+        if (auto old = snapshot.fetchAndStoreOrdered(data))
+            retiredSnapshots.append(old);
+        if (snapshotReaders.fetchAndAddOrdered(0) == 0) {
+            for (const auto &retired : std::as_const(retiredSnapshots)) {
+                releaseSnapshot(retired);
+            }
+            retiredSnapshots.clear();
+        }
+    }
+
+    void ObjectPoolPrivate::releaseSnapshot(const ObjectPoolSnapshotData *data) {
+        if (!data->refs.deref())
+            delete data;
+    }
+
+    void ObjectPoolPrivate::recordLock(QAtomicInteger<quint64> &count, QAtomicInteger<qint64> &total,
+                                       QAtomicInteger<qint64> &max, qint64 nsecs) {
+        count.fetchAndAddRelaxed(1);
+        total.fetchAndAddRelaxed(nsecs);
+        qint64 cur = max.loadRelaxed();
+        while (nsecs > cur && !max.testAndSetRelaxed(cur, nsecs, cur)) {
+        }
+    }
+
+    void ObjectPoolPrivate::recordIdLookup(const ObjectPool::Id &id) const {
+        QMutexLocker locker(&statisticsLock);
+        idLookups[id]++;
+    }
+
+    void ObjectPoolPrivate::recordTypeLookup(const QMetaObject *metaObject, const char *iid,
+                                             int scanned) const {
+        typedQueryCount.fetchAndAddRelaxed(1);
+        scannedObjectCount.fetchAndAddRelaxed(quint64(scanned));
+        QMutexLocker locker(&statisticsLock);
+        if (metaObject) {
+            typeLookups[metaObject]++;
+        } else {
+            interfaceLookups[iid]++;
+        }
+    }
+
+    void ObjectPoolPrivate::touch() {
+        chainGeneration.ref();
+        QMutexLocker locker(&childPoolsLock);
+        for (const auto &child : std::as_const(childPools)) {
+            child->touch();
+        }
+    }
+
+    template <class Func>
+    QObject *ObjectPoolPrivate::lookupChain(ChainLookup kind, quintptr key, Func find) const {
+        auto &entry = chainCache[qHash(key, uint(kind)) % ChainCacheSize];
+        const quint64 generation = chainGeneration.loadAcquire();
+
+        // The entry is used only if it was not being written while it was read
+        quint32 sequence = entry.sequence.loadAcquire();
+        if (!(sequence & 1)) {
+            const quint64 entryGeneration = entry.generation.loadRelaxed();
+            const quintptr entryKey = entry.key.loadRelaxed();
+            const int entryKind = entry.kind.loadRelaxed();
+            QObject *obj = entry.obj.loadRelaxed();
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (entry.sequence.loadRelaxed() == sequence && entryGeneration == generation &&
+                entryKey == key && entryKind == kind) {
+                return obj;
+            }
+        }
+
+        QObject *obj = nullptr;
+        for (const ObjectPool *pool = q_ptr; pool && !obj; pool = pool->parentPool()) {
+            obj = find(pool);
+        }
+
+        // Misses are cached as well. The entry keeps the generation read before the search, so it
+        // never matches if the chain changed meanwhile, for example by a factory being
+        // materialized. The address of a dead atom or meta object may be reused by another key,
+        // its entry is still right: a hit keeps its key alive until the object is removed, which
+        // bumps the generation, and a miss stays one until the chain changes.
+        QMutexLocker locker(&chainCacheLock);
+        sequence = entry.sequence.loadRelaxed();
+        entry.sequence.storeRelaxed(sequence + 1);
+        std::atomic_thread_fence(std::memory_order_release);
+        entry.generation.storeRelaxed(generation);
+        entry.key.storeRelaxed(key);
+        entry.kind.storeRelaxed(kind);
+        entry.obj.storeRelaxed(obj);
+        entry.sequence.storeRelease(sequence + 2);
+        return obj;
     }
 
-    void ObjectPoolPrivate::aboutToRemoveObject(const QString &id, QObject *obj) {
+    void ObjectPoolPrivate::objectAdded(const ObjectPool::Id &id, QObject *obj) {
         Q_Q(ObjectPool);
-        disconnect(obj, &QObject::destroyed, this, &ObjectPoolPrivate::_q_objectDestroyed);
-        Q_EMIT q->aboutToRemoveObject(id, obj);
+        auto name = id.toString();
+        Q_EMIT q->objectAdded(name, obj);
+        Q_EMIT q->objectsAdded({
+            {name, obj}
+        });
+        notifyWaiters({
+            {id, obj}
+        });
     }
 
-    void ObjectPoolPrivate::_q_objectDestroyed() {
+    void ObjectPoolPrivate::aboutToRemoveObject(const ObjectPool::Id &id, QObject *obj) {
         Q_Q(ObjectPool);
-        q->removeObject(sender());
+        auto name = id.toString();
+        Q_EMIT q->aboutToRemoveObject(name, obj);
+        Q_EMIT q->aboutToRemoveObjects({
+            {name, obj}
+        });
+    }
+
+    void ObjectPoolPrivate::objectsAdded(const QList<QPair<ObjectPool::Id, QObject *>> &objs) {
+        Q_Q(ObjectPool);
+        QList<QPair<QString, QObject *>> namedObjs;
+        namedObjs.reserve(objs.size());
+        for (const auto &item : objs) {
+            auto name = item.first.toString();
+            Q_EMIT q->objectAdded(name, item.second);
+            namedObjs.append({name, item.second});
+        }
+        Q_EMIT q->objectsAdded(namedObjs);
+        notifyWaiters(objs);
+    }
+
+    void ObjectPoolPrivate::addWaiter(const ObjectPool::Id &id, const QMetaObject *metaObject,
+                                      const char *iid, QObject *context,
+                                      const std::function<void(QObject *)> &callback) {
+        Q_Q(ObjectPool);
+        Waiter waiter{context, context != nullptr, callback, 0};
+
+        // Register before looking up, so that an object added in between is dispatched by
+        // notifyWaiters(). The lookup is done without the waiter lock since it may construct
+        // objects from factories.
+        auto access = [&](auto func) {
+            QMutexLocker locker(&waiterLock);
+            if (metaObject) {
+                return func(typeWaiters, metaObject);
+            } else if (iid) {
+                return func(interfaceWaiters, iid);
+            }
+            return func(idWaiters, id);
+        };
+        access([&](auto &waiters, const auto &key) {
+            waiter.serial = ++waiterSerial;
+            waiters[key].append(waiter);
+            waiterCount.ref();
+            return true;
+        });
+
+        QObject *obj;
+        if (metaObject) {
+            obj = q->firstObjectOfType(metaObject);
+        } else if (iid) {
+            obj = q->firstObjectOfInterface(iid);
+        } else {
+            obj = q->getFirstObject(id);
+        }
+        if (!obj) {
+            return;
+        }
+
+        // Take the waiter back unless it has been dispatched by an addition
+        bool taken = access([&](auto &waiters, const auto &key) {
+            auto it = waiters.find(key);
+            if (it == waiters.end())
+                return false;
+            auto &list = it.value();
+            for (int i = 0; i < list.size(); ++i) {
+                if (list.at(i).serial == waiter.serial) {
+                    list.removeAt(i);
+                    if (list.isEmpty()) {
+                        waiters.erase(it);
+                    }
+                    waiterCount.deref();
+                    return true;
+                }
+            }
+            return false;
+        });
+        if (taken) {
+            invokeWaiter(waiter, obj);
+        }
+    }
+
+    void ObjectPoolPrivate::notifyWaiters(const QList<QPair<ObjectPool::Id, QObject *>> &objs) {
+        if (waiterCount.loadAcquire() == 0)
+            return;
+
+        QList<QPair<Waiter, QObject *>> waitersToInvoke;
+        {
+            QMutexLocker locker(&waiterLock);
+            auto take = [&](auto &waiters, const auto &key, QObject *obj) {
+                auto it = waiters.find(key);
+                if (it == waiters.end())
+                    return;
+                for (const auto &waiter : qAsConst(it.value())) {
+                    waitersToInvoke.append({waiter, obj});
+                    waiterCount.deref();
+                }
+                waiters.erase(it);
+            };
+            for (const auto &item : objs) {
+                if (!idWaiters.isEmpty()) {
+                    take(idWaiters, item.first, item.second);
+                }
+                if (!typeWaiters.isEmpty()) {
+                    // Only the waiters of the classes in the chain are visited
+                    for (auto mo = item.second->metaObject(); mo; mo = mo->superClass()) {
+                        take(typeWaiters, mo, item.second);
+                    }
+                }
+                for (auto it = interfaceWaiters.begin(); it != interfaceWaiters.end();) {
+                    if (!item.second->qt_metacast(it.key())) {
+                        ++it;
+                        continue;
+                    }
+                    for (const auto &waiter : qAsConst(it.value())) {
+                        waitersToInvoke.append({waiter, item.second});
+                        waiterCount.deref();
+                    }
+                    it = interfaceWaiters.erase(it);
+                }
+            }
+        }
+
+        for (const auto &item : qAsConst(waitersToInvoke)) {
+            invokeWaiter(item.first, item.second);
+        }
+    }
+
+    void ObjectPoolPrivate::invokeWaiter(const Waiter &waiter, QObject *obj) {
+        if (!waiter.hasContext) {
+            waiter.callback(obj);
+            return;
+        }
+        if (!waiter.context) {
+            return; // context destroyed
+        }
+        if (waiter.context->thread() == QThread::currentThread()) {
+            waiter.callback(obj);
+            return;
+        }
+        QPointer<QObject> guard(obj);
+        QMetaObject::invokeMethod(
+            waiter.context,
+            [callback = waiter.callback, guard]() {
+                if (guard)
+                    callback(guard.data());
+            },
+            Qt::QueuedConnection);
+    }
+
+    void ObjectPoolPrivate::aboutToRemoveObjects(
+        const QList<QPair<ObjectPool::Id, QObject *>> &objs) {
+        Q_Q(ObjectPool);
+        QList<QPair<QString, QObject *>> namedObjs;
+        namedObjs.reserve(objs.size());
+        for (const auto &item : objs) {
+            auto name = item.first.toString();
+            Q_EMIT q->aboutToRemoveObject(name, item.second);
+            namedObjs.append({name, item.second});
+        }
+        Q_EMIT q->aboutToRemoveObjects(namedObjs);
+    }
+
+    void ObjectPoolPrivate::_q_objectDestroyed(QObject *obj) {
+        Q_Q(ObjectPool);
+        q->removeObject(obj);
     }
 
     ObjectPool::ObjectPool(QObject *parent) : ObjectPool(*new ObjectPoolPrivate(), parent) {
@@ -40,6 +851,18 @@ namespace Core {
 
     ObjectPool::~ObjectPool() {
         Q_D(ObjectPool);
+
+        // Leave the chain, the pools chained to this one are left without a parent
+        setParentPool(nullptr);
+        QVector<ObjectPoolPrivate *> children;
+        {
+            QMutexLocker locker(&d->childPoolsLock);
+            children = d->childPools;
+        }
+        for (const auto &child : std::as_const(children)) {
+            child->q_ptr->setParentPool(nullptr);
+        }
+
 #ifndef DISABLE_WARNING_OBJECTS_LEFT
         if (!d->objects.empty()) {
             qDebug() << "There are" << d->objects.size() << "objects left in the object pool.";
@@ -53,10 +876,14 @@ namespace Core {
     }
 
     void ObjectPool::addObject(QObject *obj) {
-        addObject({}, obj);
+        addObject(Id(), obj);
     }
 
     void ObjectPool::addObject(const QString &id, QObject *obj) {
+        addObject(Id(id), obj);
+    }
+
+    void ObjectPool::addObject(const Id &id, QObject *obj) {
         Q_D(ObjectPool);
         if (!obj) {
             myWarning(__func__) << "trying to add null object";
@@ -64,28 +891,106 @@ namespace Core {
         }
 
         {
-            QWriteLocker locker(&d->objectListLock);
-            auto &set = d->objectMap[id];
-            if (!set.append(obj).second) {
-                myWarning(__func__) << "trying to add duplicated object:" << id << obj;
+            ListWriteLocker locker(d);
+            if (!d->insertObject(id, obj)) {
                 return;
             }
+            d->touch();
+        }
+
+        d->objectAdded(id, obj);
+    }
 
-            // Add to list
-            auto it = d->objects.insert(d->objects.end(), obj);
+    void ObjectPool::addFactory(const QString &id, const QMetaObject *metaObject,
+                                const std::function<QObject *()> &factory) {
+        addFactory(Id(id), metaObject, factory);
+    }
 
-            // Add to index
-            d->objectIndexes.insert(obj, {id, it});
+    void ObjectPool::addFactory(const Id &id, const QMetaObject *metaObject,
+                                const std::function<QObject *()> &factory) {
+        Q_D(ObjectPool);
+        if (!metaObject || !factory) {
+            myWarning(__func__) << "trying to add invalid factory:" << id.toString();
+            return;
         }
 
-        d->objectAdded(id, obj);
+        QMutexLocker locker(&d->factoryLock);
+        d->factories.push_back({id, metaObject, factory});
+        d->factoryCount.ref();
+        d->touch(); // cached misses may now be resolved by the factory
+    }
+
+    QList<QPair<QString, const QMetaObject *>> ObjectPool::unusedFactories() const {
+        Q_D(const ObjectPool);
+        QMutexLocker locker(&d->factoryLock);
+        QList<QPair<QString, const QMetaObject *>> res;
+        res.reserve(int(d->factories.size()));
+        for (const auto &f : d->factories) {
+            res.append({f.id.toString(), f.metaObject});
+        }
+        return res;
+    }
+
+    void ObjectPool::whenAvailable(const QString &id, QObject *context,
+                                   const std::function<void(QObject *)> &callback) {
+        whenAvailable(Id(id), context, callback);
+    }
+
+    void ObjectPool::whenAvailable(const Id &id, QObject *context,
+                                   const std::function<void(QObject *)> &callback) {
+        Q_D(ObjectPool);
+        d->addWaiter(id, nullptr, nullptr, context, callback);
+    }
+
+    void ObjectPool::whenAvailable(const QMetaObject *metaObject, const char *iid,
+                                   QObject *context,
+                                   const std::function<void(QObject *)> &callback) {
+        Q_D(ObjectPool);
+        if (!metaObject && !iid)
+            return;
+        d->addWaiter({}, metaObject, iid, context, callback);
+    }
+
+    void ObjectPool::postObject(QObject *obj) {
+        postObject(Id(), obj);
+    }
+
+    void ObjectPool::postObject(const QString &id, QObject *obj) {
+        postObject(Id(id), obj);
+    }
+
+    void ObjectPool::postObject(const Id &id, QObject *obj) {
+        Q_D(ObjectPool);
+        if (!obj) {
+            myWarning(__func__) << "trying to post null object";
+            return;
+        }
+        d->pushPosted(new ObjectPoolPrivate::PostedNode{id, obj, nullptr});
+    }
+
+    void ObjectPool::flushPostedObjects() {
+        Q_D(ObjectPool);
+        if (thread() != QThread::currentThread()) {
+            myWarning(__func__) << "must be called in the thread of the pool";
+            return;
+        }
+        d->drainPosted();
+    }
+
+    void ObjectPool::addObjects(const QString &id, const QList<QObject *> &objs) {
+        addObjects(Id(id), objs);
+    }
+
+    void ObjectPool::addObjects(const Id &id, const QList<QObject *> &objs) {
+        Batch batch(this);
+        batch.addObjects(id, objs);
     }
 
     void ObjectPool::removeObject(QObject *obj) {
         Q_D(ObjectPool);
-        QString id;
+        Id id;
         {
-            QReadLocker locker(&d->objectListLock);
+            ListReadLocker locker(d);
 
             auto it = d->objectIndexes.find(obj);
             if (it == d->objectIndexes.end()) {
@@ -94,64 +999,62 @@ namespace Core {
             }
 
             id = it.value().id;
+
+            // Not to be removed twice if destroyed by a listener
+            disconnect(obj, &QObject::destroyed, d, &ObjectPoolPrivate::_q_objectDestroyed);
         }
 
         d->aboutToRemoveObject(id, obj);
 
         {
-            QWriteLocker locker(&d->objectListLock);
-            {
-                auto it = d->objectMap.find(id);
-
-                // Remove from map
-                auto &set = it.value();
-                set.remove(obj);
-                if (set.isEmpty()) {
-                    d->objectMap.erase(it);
-                }
-            }
-
-            {
-                auto it = d->objectIndexes.find(obj);
-
-                // Remove from list
-                d->objects.erase(it->it);
-
-                // Remove from indexes
-                d->objectIndexes.erase(it);
+            ListWriteLocker locker(d);
+            if (d->eraseObject(obj)) {
+                d->touch();
             }
         }
     }
 
     void ObjectPool::removeObjects(const QString &id) {
         Q_D(ObjectPool);
-        QList<QObject *> objs;
-        {
-            QReadLocker locker(&d->objectListLock);
-            auto it = d->objectMap.find(id);
-            if (it == d->objectMap.end()) {
-                return;
-            }
-            objs = it->values_qlist();
-        }
+        bool ok;
+        if (auto atom = d->idOf(id, &ok); ok)
+            removeObjects(atom);
+    }
 
-        for (const auto &obj : qAsConst(objs)) {
-            d->aboutToRemoveObject(id, obj);
-        }
+    void ObjectPool::removeObjects(const Id &id) {
+        Batch batch(this);
+        batch.removeObjects(id);
+    }
 
-        {
-            QWriteLocker locker(&d->objectListLock);
-            auto it = d->objectMap.find(id);
-            for (const auto &item : qAsConst(it.value())) {
-                d->objectIndexes.remove(item);
-            }
-            d->objectMap.erase(it);
+    ObjectPool::Handle ObjectPool::handleOf(QObject *obj) const {
+        Q_D(const ObjectPool);
+        ListReadLocker locker(d);
+        auto it = d->objectIndexes.find(obj);
+        if (it == d->objectIndexes.end()) {
+            return {};
         }
+        return Handle(it->slot, d->handleSlots.at(int(it->slot)).generation);
+    }
+
+    QObject *ObjectPool::resolve(const Handle &handle) const {
+        Q_D(const ObjectPool);
+        if (handle.isNull())
+            return nullptr;
+        ListReadLocker locker(d);
+        if (handle.m_index >= quint32(d->handleSlots.size()))
+            return nullptr;
+        const auto &slot = d->handleSlots.at(int(handle.m_index));
+        return slot.generation == handle.m_generation ? slot.obj : nullptr;
     }
 
     QList<QObject *> ObjectPool::allObjects() const {
         Q_D(const ObjectPool);
-        return d->objectIndexes.keys();
+        ListReadLocker locker(d);
+        return QList<QObject *>(d->objects.begin(), d->objects.end());
+    }
+
+    ObjectPool::Range ObjectPool::objects() const {
+        return Range(this);
     }
 
     QReadWriteLock *ObjectPool::listLock() const {
@@ -161,7 +1064,29 @@ namespace Core {
 
     QList<QObject *> ObjectPool::getObjects(const QString &id) const {
         Q_D(const ObjectPool);
-        QReadLocker locker(&d->objectListLock);
+        if (d->factoryCount.loadAcquire() == 0 && !d->statisticsEnabled.loadRelaxed()) {
+            ListReadLocker locker(d);
+            auto objs = d->namedObjects(id);
+            return objs ? objs->values_qlist() : QList<QObject *>();
+        }
+        bool ok;
+        if (auto atom = d->idOf(id, &ok); ok)
+            return getObjects(atom);
+        return {};
+    }
+
+    QList<QObject *> ObjectPool::getObjects(const Id &id) const {
+        Q_D(const ObjectPool);
+        if (Q_UNLIKELY(d->statisticsEnabled.loadRelaxed())) {
+            d->recordIdLookup(id);
+        }
+        d->materializeFactories(
+            [&id](const ObjectPoolPrivate::Factory &f) {
+                return f.id == id; //
+            },
+            false);
+
+        ListReadLocker locker(d);
         auto it2 = d->objectMap.find(id);
         if (it2 != d->objectMap.end()) {
             return it2->values_qlist();
@@ -171,17 +1096,505 @@ namespace Core {
 
     QObject *ObjectPool::getFirstObject(const QString &id) const {
         Q_D(const ObjectPool);
-        QReadLocker locker(&d->objectListLock);
-        auto it2 = d->objectMap.find(id);
-        if (it2 != d->objectMap.end()) {
-            return it2->isEmpty() ? nullptr : *it2->begin();
+        if (d->factoryCount.loadAcquire() == 0 && !d->statisticsEnabled.loadRelaxed()) {
+            ListReadLocker locker(d);
+            auto objs = d->namedObjects(id);
+            return objs && !objs->isEmpty() ? *objs->begin() : nullptr;
+        }
+        bool ok;
+        if (auto atom = d->idOf(id, &ok); ok)
+            return getFirstObject(atom);
+        return nullptr;
+    }
+
+    QObject *ObjectPool::getFirstObject(const Id &id) const {
+        Q_D(const ObjectPool);
+        if (Q_UNLIKELY(d->statisticsEnabled.loadRelaxed())) {
+            d->recordIdLookup(id);
+        }
+        auto find = [d, &id]() -> QObject * {
+            ListReadLocker locker(d);
+            auto it2 = d->objectMap.find(id);
+            if (it2 != d->objectMap.end()) {
+                return it2->isEmpty() ? nullptr : *it2->begin();
+            }
+            return nullptr;
+        };
+        if (auto obj = find()) {
+            return obj;
+        }
+        if (!d->materializeFactories(
+                [&id](const ObjectPoolPrivate::Factory &f) {
+                    return f.id == id; //
+                },
+                true)) {
+            return nullptr;
+        }
+        return find();
+    }
+
+    QList<QObject *> ObjectPool::objectsOfType(const QMetaObject *metaObject) const {
+        Q_D(const ObjectPool);
+        d->materializeFactories(
+            [metaObject](const ObjectPoolPrivate::Factory &f) {
+                return f.metaObject->inherits(metaObject); //
+            },
+            false);
+
+        ListReadLocker locker(d);
+        auto it = d->typeIndex.find(metaObject);
+        auto res = it != d->typeIndex.end() ? it->values_qlist() : QList<QObject *>();
+        if (Q_UNLIKELY(d->statisticsEnabled.loadRelaxed())) {
+            d->recordTypeLookup(metaObject, nullptr, res.size());
+        }
+        return res;
+    }
+
+    QList<QObject *> ObjectPool::objectsOfInterface(const char *iid) const {
+        Q_D(const ObjectPool);
+        if (!iid)
+            return {};
+        auto find = [d, iid]() -> QList<QObject *> {
+            {
+                ListReadLocker locker(d);
+                auto it = d->interfaceIndex.find(iid);
+                if (it != d->interfaceIndex.end()) {
+                    return it->values_qlist();
+                }
+            }
+            ListWriteLocker locker(d);
+            return d->interfaceObjects(iid).values_qlist();
+        };
+        auto res = find();
+        if (Q_UNLIKELY(d->statisticsEnabled.loadRelaxed())) {
+            d->recordTypeLookup(nullptr, iid, res.size());
+        }
+        return res;
+    }
+
+    QObject *ObjectPool::firstObjectOfType(const QMetaObject *metaObject) const {
+        Q_D(const ObjectPool);
+        auto find = [d, metaObject]() -> QObject * {
+            ListReadLocker locker(d);
+            auto it = d->typeIndex.find(metaObject);
+            if (it != d->typeIndex.end()) {
+                return it->isEmpty() ? nullptr : *it->begin();
+            }
+            return nullptr;
+        };
+        if (Q_UNLIKELY(d->statisticsEnabled.loadRelaxed())) {
+            d->recordTypeLookup(metaObject, nullptr, 1);
+        }
+        if (auto obj = find()) {
+            return obj;
+        }
+        if (!d->materializeFactories(
+                [metaObject](const ObjectPoolPrivate::Factory &f) {
+                    return f.metaObject->inherits(metaObject); //
+                },
+                true)) {
+            return nullptr;
+        }
+        return find();
+    }
+
+    QObject *ObjectPool::firstObjectOfInterface(const char *iid) const {
+        Q_D(const ObjectPool);
+        if (!iid)
+            return nullptr;
+        if (Q_UNLIKELY(d->statisticsEnabled.loadRelaxed())) {
+            d->recordTypeLookup(nullptr, iid, 1);
+        }
+        {
+            ListReadLocker locker(d);
+            auto it = d->interfaceIndex.find(iid);
+            if (it != d->interfaceIndex.end()) {
+                return it->isEmpty() ? nullptr : *it->begin();
+            }
+        }
+        ListWriteLocker locker(d);
+        const auto &set = d->interfaceObjects(iid);
+        return set.isEmpty() ? nullptr : *set.begin();
+    }
+
+    void ObjectPool::visitObjects(const QMetaObject *metaObject, const char *iid,
+                                  VisitorFunction fn, void *data) const {
+        Q_D(const ObjectPool);
+        if (metaObject) {
+            d->materializeFactories(
+                [metaObject](const ObjectPoolPrivate::Factory &f) {
+                    return f.metaObject->inherits(metaObject); //
+                },
+                false);
+        }
+
+        // The snapshot is visited, so that the visitor can query or modify the pool
+        const auto view = snapshot();
+        const QVector<QObject *> *candidates;
+        if (metaObject) {
+            candidates = &view.objectsOfType(metaObject);
+        } else if (auto objs = iid ? view.objectsOfInterface(iid) : nullptr) {
+            candidates = objs;
+        } else {
+            // Not indexed, the visitor does the cast
+            candidates = &view.allObjects();
+        }
+
+        int scanned = 0;
+        for (const auto &obj : *candidates) {
+            scanned++;
+            if (!fn(obj, data))
+                break;
+        }
+        if (Q_UNLIKELY(d->statisticsEnabled.loadRelaxed())) {
+            d->recordTypeLookup(metaObject, iid, scanned);
+        }
+    }
+
+    void ObjectPool::visitObjects(const Id &id, VisitorFunction fn, void *data) const {
+        Q_D(const ObjectPool);
+        if (Q_UNLIKELY(d->statisticsEnabled.loadRelaxed())) {
+            d->recordIdLookup(id);
+        }
+        d->materializeFactories(
+            [&id](const ObjectPoolPrivate::Factory &f) {
+                return f.id == id; //
+            },
+            false);
+
+        const auto view = snapshot();
+        for (const auto &obj : view.getObjects(id)) {
+            if (!fn(obj, data))
+                return;
+        }
+    }
+
+    ObjectPool::Snapshot ObjectPool::snapshot() const {
+        Q_D(const ObjectPool);
+        Snapshot res;
+        res.d = d->currentSnapshot();
+        return res;
+    }
+
+    void ObjectPool::setStatisticsEnabled(bool enabled) {
+        Q_D(ObjectPool);
+        d->statisticsEnabled.storeRelaxed(enabled ? 1 : 0);
+    }
+
+    bool ObjectPool::statisticsEnabled() const {
+        Q_D(const ObjectPool);
+        return d->statisticsEnabled.loadRelaxed();
+    }
+
+    ObjectPool::Statistics ObjectPool::statistics() const {
+        Q_D(const ObjectPool);
+        Statistics res;
+        res.typedQueries = d->typedQueryCount.loadRelaxed();
+        res.scannedObjects = d->scannedObjectCount.loadRelaxed();
+        res.readLocks = d->readLockCount.loadRelaxed();
+        res.readLockWaitTime = d->readLockWaitTime.loadRelaxed();
+        res.maxReadLockWaitTime = d->maxReadLockWaitTime.loadRelaxed();
+        res.writeLocks = d->writeLockCount.loadRelaxed();
+        res.writeLockHoldTime = d->writeLockHoldTime.loadRelaxed();
+        res.maxWriteLockHoldTime = d->maxWriteLockHoldTime.loadRelaxed();
+
+        QMutexLocker locker(&d->statisticsLock);
+        for (auto it = d->idLookups.begin(); it != d->idLookups.end(); ++it) {
+            res.idLookups.insert(it.key().toString(), it.value());
+        }
+        for (auto it = d->typeLookups.begin(); it != d->typeLookups.end(); ++it) {
+            res.typeLookups[QString::fromLatin1(it.key()->className())] += it.value();
+        }
+        for (auto it = d->interfaceLookups.begin(); it != d->interfaceLookups.end(); ++it) {
+            res.typeLookups[QString::fromLatin1(it.key())] += it.value();
+        }
+        return res;
+    }
+
+    void ObjectPool::resetStatistics() {
+        Q_D(ObjectPool);
+        d->typedQueryCount.storeRelaxed(0);
+        d->scannedObjectCount.storeRelaxed(0);
+        d->readLockCount.storeRelaxed(0);
+        d->readLockWaitTime.storeRelaxed(0);
+        d->maxReadLockWaitTime.storeRelaxed(0);
+        d->writeLockCount.storeRelaxed(0);
+        d->writeLockHoldTime.storeRelaxed(0);
+        d->maxWriteLockHoldTime.storeRelaxed(0);
+
+        QMutexLocker locker(&d->statisticsLock);
+        d->idLookups.clear();
+        d->typeLookups.clear();
+        d->interfaceLookups.clear();
+    }
+
+    QJsonObject ObjectPool::Statistics::toJson() const {
+        auto counts = [](const QHash<QString, quint64> &hash) {
+            // Sorted by count, most frequent first
+            QList<QPair<QString, quint64>> list;
+            for (auto it = hash.begin(); it != hash.end(); ++it) {
+                list.append({it.key(), it.value()});
+            }
+            std::sort(list.begin(), list.end(), [](const auto &a, const auto &b) {
+                return a.second > b.second; //
+            });
+            QJsonArray arr;
+            for (const auto &item : qAsConst(list)) {
+                QJsonObject obj;
+                obj.insert("name", item.first);
+                obj.insert("count", double(item.second));
+                arr.append(obj);
+            }
+            return arr;
+        };
+
+        QJsonObject res;
+        res.insert("idLookups", counts(idLookups));
+        res.insert("typeLookups", counts(typeLookups));
+        res.insert("typedQueries", double(typedQueries));
+        res.insert("scannedObjects", double(scannedObjects));
+        res.insert("readLocks", double(readLocks));
+        res.insert("readLockWaitTime", double(readLockWaitTime));
+        res.insert("maxReadLockWaitTime", double(maxReadLockWaitTime));
+        res.insert("writeLocks", double(writeLocks));
+        res.insert("writeLockHoldTime", double(writeLockHoldTime));
+        res.insert("maxWriteLockHoldTime", double(maxWriteLockHoldTime));
+        return res;
+    }
+
+    void ObjectPool::setParentPool(ObjectPool *parent) {
+        Q_D(ObjectPool);
+        for (auto pool = parent; pool; pool = pool->parentPool()) {
+            if (pool == this) {
+                myWarning(__func__) << "trying to make a cyclic chain:" << parent;
+                return;
+            }
+        }
+
+        ListWriteLocker locker(d);
+        if (d->parentPool == parent)
+            return;
+        if (auto old = d->parentPool.data()) {
+            auto od = old->d_func();
+            QMutexLocker childLocker(&od->childPoolsLock);
+            od->childPools.removeOne(d);
+        }
+        d->parentPool = parent;
+        if (parent) {
+            auto pd = parent->d_func();
+            QMutexLocker childLocker(&pd->childPoolsLock);
+            pd->childPools.append(d);
+        }
+        d->touch();
+    }
+
+    ObjectPool *ObjectPool::parentPool() const {
+        Q_D(const ObjectPool);
+        ListReadLocker locker(d);
+        return d->parentPool.data();
+    }
+
+    QObject *ObjectPool::lookup(const QString &id) const {
+        // The first pool of the chain that knows the name provides the id
+        for (auto pool = this; pool; pool = pool->parentPool()) {
+            bool ok;
+            if (auto atom = pool->d_func()->idOf(id, &ok); ok)
+                return lookup(atom);
         }
         return nullptr;
     }
 
+    QObject *ObjectPool::lookup(const Id &id) const {
+        Q_D(const ObjectPool);
+        return d->lookupChain(ObjectPoolPrivate::IdLookup, quintptr(id.m_data),
+                              [&id](const ObjectPool *pool) {
+                                  return pool->getFirstObject(id); //
+                              });
+    }
+
+    QObject *ObjectPool::lookupOfType(const QMetaObject *metaObject) const {
+        Q_D(const ObjectPool);
+        if (!metaObject)
+            return nullptr;
+        return d->lookupChain(ObjectPoolPrivate::TypeLookup, quintptr(metaObject),
+                              [metaObject](const ObjectPool *pool) {
+                                  return pool->firstObjectOfType(metaObject); //
+                              });
+    }
+
+    QObject *ObjectPool::lookupOfInterface(const char *iid) const {
+        Q_D(const ObjectPool);
+        if (!iid)
+            return nullptr;
+        return d->lookupChain(ObjectPoolPrivate::InterfaceLookup, quintptr(iid),
+                              [iid](const ObjectPool *pool) {
+                                  return pool->firstObjectOfInterface(iid); //
+                              });
+    }
+
+    ObjectPool::Id ObjectPool::findId(const QString &name, bool *ok) const {
+        Q_D(const ObjectPool);
+        return d->idOf(name, ok);
+    }
+
     ObjectPool::ObjectPool(ObjectPoolPrivate &d, QObject *parent) : QObject(parent), d_ptr(&d) {
         d.q_ptr = this;
         d.init();
     }
 
-}
\ No newline at end of file
+    static const QVector<QObject *> &emptyObjectVector() {
+        static const QVector<QObject *> empty;
+        return empty;
+    }
+
+    ObjectPool::Snapshot::Snapshot() : d(nullptr) {
+    }
+
+    ObjectPool::Snapshot::Snapshot(const Snapshot &other) : d(other.d) {
+        if (d)
+            d->refs.ref();
+    }
+
+    ObjectPool::Snapshot &ObjectPool::Snapshot::operator=(const Snapshot &other) {
+        if (other.d)
+            other.d->refs.ref();
+        if (d)
+            ObjectPoolPrivate::releaseSnapshot(d);
+        d = other.d;
+        return *this;
+    }
+
+    ObjectPool::Snapshot::~Snapshot() {
+        if (d)
+            ObjectPoolPrivate::releaseSnapshot(d);
+    }
+
+    bool ObjectPool::Snapshot::isNull() const {
+        return !d;
+    }
+
+    const QVector<QObject *> &ObjectPool::Snapshot::allObjects() const {
+        return d ? d->objects : emptyObjectVector();
+    }
+
+    const QVector<QObject *> &ObjectPool::Snapshot::getObjects(const QString &id) const {
+        if (!d)
+            return emptyObjectVector();
+        auto it = d->names.find(id);
+        return it != d->names.end() ? getObjects(it.value()) : emptyObjectVector();
+    }
+
+    const QVector<QObject *> &ObjectPool::Snapshot::getObjects(const Id &id) const {
+        if (!d)
+            return emptyObjectVector();
+        auto it = d->objectMap.find(id);
+        return it != d->objectMap.end() ? it.value() : emptyObjectVector();
+    }
+
+    QObject *ObjectPool::Snapshot::getFirstObject(const QString &id) const {
+        const auto &objs = getObjects(id);
+        return objs.isEmpty() ? nullptr : objs.front();
+    }
+
+    QObject *ObjectPool::Snapshot::getFirstObject(const Id &id) const {
+        const auto &objs = getObjects(id);
+        return objs.isEmpty() ? nullptr : objs.front();
+    }
+
+    const QVector<QObject *> &
+        ObjectPool::Snapshot::objectsOfType(const QMetaObject *metaObject) const {
+        if (!d)
+            return emptyObjectVector();
+        auto it = d->typeIndex.find(metaObject);
+        return it != d->typeIndex.end() ? it.value() : emptyObjectVector();
+    }
+
+    const QVector<QObject *> *ObjectPool::Snapshot::objectsOfInterface(const char *iid) const {
+        if (!d)
+            return nullptr;
+        auto it = d->interfaceIndex.find(iid);
+        return it != d->interfaceIndex.end() ? &it.value() : nullptr;
+    }
+
+    ObjectPool::Batch::Batch(ObjectPool *pool) : m_pool(pool) {
+    }
+
+    ObjectPool::Batch::~Batch() {
+        commit();
+    }
+
+    void ObjectPool::Batch::addObject(QObject *obj) {
+        addObject(Id(), obj);
+    }
+
+    void ObjectPool::Batch::addObject(const QString &id, QObject *obj) {
+        addObject(Id(id), obj);
+    }
+
+    void ObjectPool::Batch::addObject(const Id &id, QObject *obj) {
+        if (!obj) {
+            myWarning(__func__) << "trying to add null object";
+            return;
+        }
+        m_additions.append({id, obj});
+    }
+
+    void ObjectPool::Batch::addObjects(const QString &id, const QList<QObject *> &objs) {
+        addObjects(Id(id), objs);
+    }
+
+    void ObjectPool::Batch::addObjects(const Id &id, const QList<QObject *> &objs) {
+        m_additions.reserve(m_additions.size() + objs.size());
+        for (const auto &obj : objs) {
+            addObject(id, obj);
+        }
+    }
+
+    void ObjectPool::Batch::removeObject(QObject *obj) {
+        // An object added in the same batch never becomes visible
+        for (auto it = m_additions.begin(); it != m_additions.end(); ++it) {
+            if (it->second == obj) {
+                m_additions.erase(it);
+                return;
+            }
+        }
+        m_removals.append(obj);
+    }
+
+    void ObjectPool::Batch::removeObjects(const QString &id) {
+        if (!m_pool)
+            return;
+        bool ok;
+        if (auto atom = m_pool->d_func()->idOf(id, &ok); ok)
+            removeObjects(atom);
+    }
+
+    void ObjectPool::Batch::removeObjects(const Id &id) {
+        m_additions.erase(std::remove_if(m_additions.begin(), m_additions.end(),
+                                         [&id](const QPair<Id, QObject *> &item) {
+                                             return item.first == id; //
+                                         }),
+                          m_additions.end());
+        m_idRemovals.append(id);
+    }
+
+    void ObjectPool::Batch::commit() {
+        if (!m_pool ||
+            (m_additions.isEmpty() && m_removals.isEmpty() && m_idRemovals.isEmpty())) {
+            return;
+        }
+
+        auto additions = std::move(m_additions);
+        auto removals = std::move(m_removals);
+        auto idRemovals = std::move(m_idRemovals);
+        m_additions.clear();
+        m_removals.clear();
+        m_idRemovals.clear();
+
+        m_pool->d_func()->commitBatch(additions, removals, idRemovals);
+    }
+
+    ObjectPool::Range::Range(const ObjectPool *pool) : m_snapshot(pool->snapshot()) {
+    }
+
+}
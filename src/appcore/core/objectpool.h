@@ -1,16 +1,26 @@
 #ifndef OBJECTPOOL_H
 #define OBJECTPOOL_H
 
+#include <functional>
+#include <utility>
+#include <type_traits>
+
 #include <QReadWriteLock>
 #include <QVariant>
 #include <QWidget>
 
 #include <CoreApi/ckappcoreglobal.h>
 
+class QJsonObject;
+
 namespace Core {
 
     class ObjectPoolPrivate;
 
+    class ObjectPoolSnapshotData;
+
+    class ObjectPoolIdData;
+
     class CKAPPCORE_EXPORT ObjectPool : public QObject {
         Q_OBJECT
         Q_DECLARE_PRIVATE(ObjectPool)
@@ -18,27 +28,349 @@ namespace Core {
         explicit ObjectPool(QObject *parent = nullptr);
         ~ObjectPool();
 
+        // Interned object id, equal strings share one atom so that comparing and hashing are
+        // integer operations. Atoms are reference counted and released with the last Id referring
+        // to them, ids created at run time don't outlive the objects added under them. The
+        // lookups taking a QString resolve it against the ids in the pool without interning it.
+        class CKAPPCORE_EXPORT Id {
+        public:
+            Q_DECL_CONSTEXPR inline Id() : m_data(nullptr) {
+            }
+            explicit Id(const QString &name);
+            explicit Id(const char *name);
+
+            inline Id(const Id &other) : m_data(other.m_data) {
+                if (m_data)
+                    ref(m_data);
+            }
+            inline Id(Id &&other) Q_DECL_NOTHROW : m_data(other.m_data) {
+                other.m_data = nullptr;
+            }
+            inline ~Id() {
+                if (m_data)
+                    deref(m_data);
+            }
+            inline Id &operator=(const Id &other) {
+                Id(other).swap(*this);
+                return *this;
+            }
+            inline Id &operator=(Id &&other) Q_DECL_NOTHROW {
+                Id(std::move(other)).swap(*this);
+                return *this;
+            }
+            inline void swap(Id &other) Q_DECL_NOTHROW {
+                std::swap(m_data, other.m_data);
+            }
+
+            // Returns the existing atom without interning, ok is false if there's none
+            static Id lookup(const QString &name, bool *ok = nullptr);
+
+            // Number of atoms alive in the process
+            static int atomCount();
+
+            inline bool isEmpty() const {
+                return !m_data;
+            }
+            QString toString() const;
+
+            inline bool operator==(const Id &other) const {
+                return m_data == other.m_data;
+            }
+            inline bool operator!=(const Id &other) const {
+                return m_data != other.m_data;
+            }
+
+            friend inline uint qHash(const Id &id, uint seed = 0) Q_DECL_NOTHROW {
+                return ::qHash(quintptr(id.m_data), seed);
+            }
+
+        private:
+            static void ref(const ObjectPoolIdData *data);
+            static void deref(const ObjectPoolIdData *data);
+
+            const ObjectPoolIdData *m_data;
+
+            friend class ObjectPool;
+        };
+
+        // Weak reference to a pooled object, resolves to null once the object has been removed
+        // or destroyed, even if another object is later allocated at the same address. Objects
+        // destroyed in another thread are removed when the pool's thread is notified.
+        class Handle {
+        public:
+            Q_DECL_CONSTEXPR inline Handle() : m_index(0), m_generation(0) {
+            }
+
+            inline bool isNull() const {
+                return m_generation == 0;
+            }
+
+            inline bool operator==(const Handle &other) const {
+                return m_index == other.m_index && m_generation == other.m_generation;
+            }
+            inline bool operator!=(const Handle &other) const {
+                return !(*this == other);
+            }
+
+            friend inline uint qHash(const Handle &handle, uint seed = 0) Q_DECL_NOTHROW {
+                return ::qHash((quint64(handle.m_index) << 32) | handle.m_generation, seed);
+            }
+
+        private:
+            Q_DECL_CONSTEXPR inline Handle(quint32 index, quint32 generation)
+                : m_index(index), m_generation(generation) {
+            }
+
+            quint32 m_index;
+            quint32 m_generation;
+
+            friend class ObjectPool;
+        };
+
+        // Immutable view of the pool at some point, safe to be queried from any thread without
+        // locking, the returned containers are references into the view.
+        class CKAPPCORE_EXPORT Snapshot {
+        public:
+            Snapshot();
+            Snapshot(const Snapshot &other);
+            Snapshot &operator=(const Snapshot &other);
+            ~Snapshot();
+
+            bool isNull() const;
+
+            const QVector<QObject *> &allObjects() const;
+            const QVector<QObject *> &getObjects(const QString &id) const;
+            const QVector<QObject *> &getObjects(const Id &id) const;
+            QObject *getFirstObject(const QString &id) const;
+            QObject *getFirstObject(const Id &id) const;
+
+            const QVector<QObject *> &objectsOfType(const QMetaObject *metaObject) const;
+            const QVector<QObject *> *objectsOfInterface(const char *iid) const;
+
+            template <class T>
+            QList<T *> getObjects() const {
+                QList<T *> res;
+                visit<T>([&res](T *obj) {
+                    res.append(obj);
+                    return true;
+                });
+                return res;
+            }
+
+            template <typename T, typename Predicate>
+            QList<T *> getObjects(Predicate predicate) const {
+                QList<T *> res;
+                visit<T>([&res, &predicate](T *obj) {
+                    if (predicate(obj))
+                        res.append(obj);
+                    return true;
+                });
+                return res;
+            }
+
+            template <typename T>
+            T *getFirstObject() const {
+                T *res = nullptr;
+                visit<T>([&res](T *obj) {
+                    res = obj;
+                    return false;
+                });
+                return res;
+            }
+
+            template <typename T, typename Predicate>
+            T *getFirstObject(Predicate predicate) const {
+                T *res = nullptr;
+                visit<T>([&res, &predicate](T *obj) {
+                    if (!predicate(obj))
+                        return true;
+                    res = obj;
+                    return false;
+                });
+                return res;
+            }
+
+        private:
+            template <class T, class Visitor>
+            void visit(Visitor visitor) const {
+                if constexpr (std::is_base_of<QObject, T>::value) {
+                    for (QObject *obj : objectsOfType(&T::staticMetaObject)) {
+                        if (!visitor(static_cast<T *>(obj)))
+                            return;
+                    }
+                } else {
+                    // Interfaces that have never been queried on the pool are not indexed
+                    auto candidates = objectsOfInterface(qobject_interface_iid<T *>());
+                    for (QObject *obj : candidates ? *candidates : allObjects()) {
+                        if (T *result = qobject_cast<T *>(obj))
+                            if (!visitor(result))
+                                return;
+                    }
+                }
+            }
+
+            const ObjectPoolSnapshotData *d;
+
+            friend class ObjectPool;
+        };
+
+        // Collects additions and removals and applies them under a single lock acquisition when
+        // committed or destroyed, removals are applied before additions. Listeners are notified
+        // by one objectsAdded() and one aboutToRemoveObjects() for the whole batch.
+        class CKAPPCORE_EXPORT Batch {
+        public:
+            explicit Batch(ObjectPool *pool);
+            ~Batch();
+
+            void addObject(QObject *obj);
+            void addObject(const QString &id, QObject *obj);
+            void addObject(const Id &id, QObject *obj);
+            void addObjects(const QString &id, const QList<QObject *> &objs);
+            void addObjects(const Id &id, const QList<QObject *> &objs);
+            void removeObject(QObject *obj);
+            void removeObjects(const QString &id);
+            void removeObjects(const Id &id);
+
+            void commit();
+
+        private:
+            ObjectPool *m_pool;
+            QList<QPair<Id, QObject *>> m_additions;
+            QList<QObject *> m_removals;
+            QList<Id> m_idRemovals;
+
+            Q_DISABLE_COPY(Batch)
+        };
+
     public:
         void addObject(QObject *obj);
         void addObject(const QString &id, QObject *obj);
-        inline void addObjects(const QString &id, const QList<QObject *> &objs) {
-            for (const auto &obj : objs) {
-                addObject(id, obj);
-            }
-        }
+        void addObject(const Id &id, QObject *obj);
+        void addObjects(const QString &id, const QList<QObject *> &objs);
+        void addObjects(const Id &id, const QList<QObject *> &objs);
+
+        // Registers an object to be constructed on the first lookup that matches it by id or by
+        // class (interface lookups cannot match a factory), objectAdded() is emitted then.
+        // Enumerations of all objects and snapshots don't construct pending objects.
+        void addFactory(const QString &id, const QMetaObject *metaObject,
+                        const std::function<QObject *()> &factory);
+        void addFactory(const Id &id, const QMetaObject *metaObject,
+                        const std::function<QObject *()> &factory);
+        template <class T>
+        inline void addFactory(const QString &id, const std::function<T *()> &factory);
+        template <class T>
+        inline void addFactory(const Id &id, const std::function<T *()> &factory);
+        QList<QPair<QString, const QMetaObject *>> unusedFactories() const;
+
+        // Thread-safe registration for objects created in worker threads. The objects are staged
+        // without locking and added in one batch by the thread of the pool when its event loop
+        // runs, so that listeners are always notified in the pool's thread. Until then they are
+        // not visible to any lookup, flushPostedObjects() adds them at once from the pool's
+        // thread. The pool doesn't own the posted objects and only keeps their addresses, they
+        // must stay alive until they are added, destroying one before is undefined. The thread
+        // affinity of the objects is left unchanged.
+        void postObject(QObject *obj);
+        void postObject(const QString &id, QObject *obj);
+        void postObject(const Id &id, QObject *obj);
+        void flushPostedObjects();
+
+        // Calls back once with the first matching object, immediately if there's one already or
+        // when it's added later. The callback is invoked in the thread of the context and is
+        // dropped if the context is destroyed before.
+        void whenAvailable(const QString &id, QObject *context,
+                           const std::function<void(QObject *)> &callback);
+        void whenAvailable(const Id &id, QObject *context,
+                           const std::function<void(QObject *)> &callback);
+        template <class T, class Func>
+        inline void whenAvailable(QObject *context, Func callback);
+
         void removeObject(QObject *obj);
         void removeObjects(const QString &id);
+        void removeObjects(const Id &id);
+
+        // Handles are validated in constant time, handleOf() returns a null handle if the object
+        // is not in the pool.
+        Handle handleOf(QObject *obj) const;
+        QObject *resolve(const Handle &handle) const;
+        template <class T>
+        inline T *resolve(const Handle &handle) const {
+            return qobject_cast<T *>(resolve(handle));
+        }
+        inline bool isValid(const Handle &handle) const {
+            return resolve(handle) != nullptr;
+        }
+
         QList<QObject *> allObjects() const;
         QReadWriteLock *listLock() const;
 
+        // All objects in insertion order as of the current snapshot, the loop body may query or
+        // modify the pool, objects removed in the meantime are still iterated.
+        class CKAPPCORE_EXPORT Range {
+        public:
+            using const_iterator = QVector<QObject *>::const_iterator;
+
+            inline const_iterator begin() const {
+                return m_snapshot.allObjects().cbegin();
+            }
+            inline const_iterator end() const {
+                return m_snapshot.allObjects().cend();
+            }
+            inline bool isEmpty() const {
+                return m_snapshot.allObjects().isEmpty();
+            }
+
+        private:
+            explicit Range(const ObjectPool *pool);
+
+            Snapshot m_snapshot;
+
+            Q_DISABLE_COPY(Range)
+
+            friend class ObjectPool;
+        };
+
+        Range objects() const;
+
+        // Calls the visitor on each object of the type (or with the id) in insertion order, the
+        // visitor may return false to stop. The objects are visited from the current snapshot, so
+        // that the visitor can query or modify the pool; objects removed in the meantime are still
+        // visited. Nothing is allocated unless the pool changed since the last snapshot, which is
+        // rebuilt then.
+        template <class T = QObject, class Visitor>
+        void forEachObject(Visitor visitor) const {
+            auto fn = [](QObject *obj, void *data) -> bool {
+                return invokeVisitor<T>(*static_cast<Visitor *>(data), obj);
+            };
+            if constexpr (std::is_base_of<QObject, T>::value) {
+                visitObjects(&T::staticMetaObject, nullptr, fn, &visitor);
+            } else {
+                visitObjects(nullptr, qobject_interface_iid<T *>(), fn, &visitor);
+            }
+        }
+
+        template <class T = QObject, class Visitor>
+        void forEachObject(const Id &id, Visitor visitor) const {
+            auto fn = [](QObject *obj, void *data) -> bool {
+                return invokeVisitor<T>(*static_cast<Visitor *>(data), obj);
+            };
+            visitObjects(id, fn, &visitor);
+        }
+
+        template <class T = QObject, class Visitor>
+        inline void forEachObject(const QString &id, Visitor visitor) const {
+            bool ok;
+            if (auto atom = findId(id, &ok); ok)
+                forEachObject<T>(atom, std::move(visitor));
+        }
+
         QList<QObject *> getObjects(const QString &id) const;
+        QList<QObject *> getObjects(const Id &id) const;
 
         template <typename T, typename Predicate>
         QList<T *> getObjects(Predicate predicate) const {
-            QReadLocker lock(listLock());
             QList<T *> results;
-            QList<QObject *> all = allObjects();
-            foreach (QObject *obj, all) {
+            const auto &candidates = typedObjects<T>();
+            for (QObject *obj : candidates) {
                 T *result = qobject_cast<T *>(obj);
                 if (result && predicate(result))
                     results += result;
@@ -48,10 +380,10 @@ namespace Core {
 
         template <class T>
         QList<T *> getObjects() const {
-            QReadLocker lock(listLock());
-            QList<QObject *> all = allObjects();
-            QList<QObject *> res;
-            foreach (QObject *obj, all) {
+            QList<T *> res;
+            const auto &candidates = typedObjects<T>();
+            res.reserve(candidates.size());
+            for (QObject *obj : candidates) {
                 if (T *result = qobject_cast<T *>(obj))
                     res.append(result);
             }
@@ -59,40 +391,155 @@ namespace Core {
         }
 
         QObject *getFirstObject(const QString &id) const;
+        QObject *getFirstObject(const Id &id) const;
 
         template <typename T>
-        T *getFirstObject() {
-            QReadLocker lock(listLock());
-            QList<QObject *> all = allObjects();
-            foreach (QObject *obj, all) {
-                if (T *result = qobject_cast<T *>(obj))
-                    return result;
+        T *getFirstObject() const {
+            if constexpr (std::is_base_of<QObject, T>::value) {
+                return static_cast<T *>(firstObjectOfType(&T::staticMetaObject));
+            } else {
+                return qobject_cast<T *>(firstObjectOfInterface(qobject_interface_iid<T *>()));
             }
-            return 0;
         }
 
         template <typename T, typename Predicate>
         T *getFirstObject(Predicate predicate) const {
-            QReadLocker lock(listLock());
-            QList<QObject *> all = allObjects();
-            foreach (QObject *obj, all) {
+            const auto &candidates = typedObjects<T>();
+            for (QObject *obj : candidates) {
                 if (T *result = qobject_cast<T *>(obj))
                     if (predicate(result))
                         return result;
             }
-            return 0;
+            return nullptr;
+        }
+
+        // Typed lookups are answered from an index maintained on insertion, a class matches all
+        // objects whose meta object inherits it, an interface matches all objects whose
+        // qt_metacast() accepts its IID.
+        QList<QObject *> objectsOfType(const QMetaObject *metaObject) const;
+        QList<QObject *> objectsOfInterface(const char *iid) const;
+        QObject *firstObjectOfType(const QMetaObject *metaObject) const;
+        QObject *firstObjectOfInterface(const char *iid) const;
+
+        // Returns a snapshot of the current state. The first call after a modification builds it
+        // under the read lock and the following ones share it without locking, the writers only
+        // mark it out of date.
+        Snapshot snapshot() const;
+
+        // Lookup and lock statistics, collected only while enabled, times are in nanoseconds.
+        // Typed queries count the lookups by class or interface, the scanned objects are the
+        // candidates they returned or visited.
+        class CKAPPCORE_EXPORT Statistics {
+        public:
+            QHash<QString, quint64> idLookups;
+            QHash<QString, quint64> typeLookups; // class names and interface IIDs
+            quint64 typedQueries = 0;
+            quint64 scannedObjects = 0;
+            quint64 readLocks = 0;
+            qint64 readLockWaitTime = 0;
+            qint64 maxReadLockWaitTime = 0;
+            quint64 writeLocks = 0;
+            qint64 writeLockHoldTime = 0;
+            qint64 maxWriteLockHoldTime = 0;
+
+            QJsonObject toJson() const;
+        };
+
+        void setStatisticsEnabled(bool enabled);
+        bool statisticsEnabled() const;
+        Statistics statistics() const;
+        void resetStatistics();
+
+        // Pools can be chained, the lookup*() functions search this pool first and then its
+        // ancestors. Results are cached per pool until any pool in the chain is modified.
+        void setParentPool(ObjectPool *parent);
+        ObjectPool *parentPool() const;
+
+        QObject *lookup(const QString &id) const;
+        QObject *lookup(const Id &id) const;
+        QObject *lookupOfType(const QMetaObject *metaObject) const;
+        QObject *lookupOfInterface(const char *iid) const;
+
+        template <typename T>
+        T *lookup() const {
+            if constexpr (std::is_base_of<QObject, T>::value) {
+                return static_cast<T *>(lookupOfType(&T::staticMetaObject));
+            } else {
+                return qobject_cast<T *>(lookupOfInterface(qobject_interface_iid<T *>()));
+            }
+        }
+
+    private:
+        void whenAvailable(const QMetaObject *metaObject, const char *iid, QObject *context,
+                           const std::function<void(QObject *)> &callback);
+
+        using VisitorFunction = bool (*)(QObject *, void *);
+        void visitObjects(const QMetaObject *metaObject, const char *iid, VisitorFunction fn,
+                          void *data) const;
+        void visitObjects(const Id &id, VisitorFunction fn, void *data) const;
+        Id findId(const QString &name, bool *ok) const;
+
+        template <class T, class Visitor>
+        static inline bool invokeVisitor(Visitor &visitor, QObject *obj) {
+            T *res = qobject_cast<T *>(obj);
+            if (!res)
+                return true;
+            if constexpr (std::is_void<std::invoke_result_t<Visitor &, T *>>::value) {
+                visitor(res);
+                return true;
+            } else {
+                return visitor(res);
+            }
+        }
+
+        template <class T>
+        inline QList<QObject *> typedObjects() const {
+            if constexpr (std::is_base_of<QObject, T>::value) {
+                return objectsOfType(&T::staticMetaObject);
+            } else {
+                return objectsOfInterface(qobject_interface_iid<T *>());
+            }
         }
 
     Q_SIGNALS:
         void objectAdded(const QString &id, QObject *obj);
         void aboutToRemoveObject(const QString &id, QObject *obj);
 
+        // Emitted once per batch, or once per single operation with one element
+        void objectsAdded(const QList<QPair<QString, QObject *>> &objs);
+        void aboutToRemoveObjects(const QList<QPair<QString, QObject *>> &objs);
+
     protected:
         ObjectPool(ObjectPoolPrivate &d, QObject *parent = nullptr);
 
         QScopedPointer<ObjectPoolPrivate> d_ptr;
     };
 
+    template <class T, class Func>
+    inline void ObjectPool::whenAvailable(QObject *context, Func callback) {
+        auto fn = [callback = std::move(callback)](QObject *obj) mutable {
+            callback(qobject_cast<T *>(obj)); //
+        };
+        if constexpr (std::is_base_of<QObject, T>::value) {
+            whenAvailable(&T::staticMetaObject, nullptr, context, fn);
+        } else {
+            whenAvailable(nullptr, qobject_interface_iid<T *>(), context, fn);
+        }
+    }
+
+    template <class T>
+    inline void ObjectPool::addFactory(const QString &id, const std::function<T *()> &factory) {
+        addFactory<T>(Id(id), factory);
+    }
+
+    template <class T>
+    inline void ObjectPool::addFactory(const Id &id, const std::function<T *()> &factory) {
+        static_assert(std::is_base_of<QObject, T>::value, "T should inherit from QObject");
+        addFactory(id, &T::staticMetaObject, [factory]() -> QObject * {
+            return factory(); //
+        });
+    }
+
 }
 
 
@@ -1,12 +1,29 @@
 #ifndef OBJECTPOOL_P_H
 #define OBJECTPOOL_P_H
 
+#include <list>
+
+#include <QMutex>
+#include <QPointer>
+#include <QWaitCondition>
+
 #include <QMCore/qmchronoset.h>
 
 #include <CoreApi/objectpool.h>
 
 namespace Core {
 
+    class ObjectPoolSnapshotData {
+    public:
+        mutable QAtomicInt refs;
+        quint64 version; // of the pool when built
+        QVector<QObject *> objects;
+        QHash<QString, ObjectPool::Id> names;
+        QHash<ObjectPool::Id, QVector<QObject *>> objectMap;
+        QHash<const QMetaObject *, QVector<QObject *>> typeIndex;
+        QHash<const char *, QVector<QObject *>> interfaceIndex;
+    };
+
     class ObjectPoolPrivate : public QObject {
         Q_DECLARE_PUBLIC(ObjectPool)
     public:
@@ -21,25 +38,181 @@ namespace Core {
         std::list<QObject *> objects;
 
         // id -> objects with same id
-        QHash<QString, QMChronoSet<QObject *>> objectMap;
+        QHash<ObjectPool::Id, QMChronoSet<QObject *>> objectMap;
+
+        // name -> id of the objects, so that names are looked up without the global id table
+        QHash<QString, ObjectPool::Id> idNames;
+
+        const QMChronoSet<QObject *> *namedObjects(const QString &name) const;
+        ObjectPool::Id idOf(const QString &name, bool *ok) const;
 
         struct Index {
-            QString id;
+            ObjectPool::Id id;
             decltype(objects)::iterator it;
+            const QMetaObject *metaObject; // saved since it's unreliable during destruction
+            quint32 slot;
         };
 
         // object -> index
         QHash<QObject *, Index> objectIndexes;
 
+        // Handle slot map, a slot's generation is bumped whenever it's released so that stale
+        // handles never resolve
+        struct HandleSlot {
+            QObject *obj;
+            quint32 generation;
+        };
+        QVector<HandleSlot> handleSlots;
+        QVector<quint32> freeHandleSlots;
+
+        quint32 allocateSlot(QObject *obj);
+        void releaseSlot(quint32 index);
+
+        // class -> objects of the class and its subclasses
+        QHash<const QMetaObject *, QMChronoSet<QObject *>> typeIndex;
+
+        // interface iid -> objects implementing the interface, built on first query
+        mutable QHash<const char *, QMChronoSet<QObject *>> interfaceIndex;
+
         mutable QReadWriteLock objectListLock;
 
-        void objectAdded(const QString &id, QObject *obj);
-        void aboutToRemoveObject(const QString &id, QObject *obj);
+        // Snapshot built by the last snapshot() call, the pool holds a reference to it. It's
+        // rebuilt by the first call after a modification, so the writers never pay for it. Readers
+        // count themselves in while taking their reference, a replaced snapshot is released once
+        // none is in and kept in the retired list until then.
+        mutable QAtomicPointer<ObjectPoolSnapshotData> snapshot;
+        mutable QAtomicInt snapshotReaders;
+        mutable QVector<ObjectPoolSnapshotData *> retiredSnapshots;
+        mutable QMutex snapshotLock;
+        mutable QAtomicInteger<quint64> snapshotVersion; // bumped by each modification
+
+        void indexObject(QObject *obj, const QMetaObject *metaObject);
+        void unindexObject(QObject *obj, const QMetaObject *metaObject);
+        const QMChronoSet<QObject *> &interfaceObjects(const char *iid) const;
+
+        // Factories not materialized yet, and the ones being run outside of the lock
+        struct Factory {
+            ObjectPool::Id id;
+            const QMetaObject *metaObject;
+            std::function<QObject *()> create;
+            Qt::HANDLE thread = nullptr; // materializing thread
+        };
+        mutable std::list<Factory> factories;
+        mutable std::list<Factory> materializing;
+        mutable QAtomicInt factoryCount; // both lists
+        mutable QMutex factoryLock;
+        mutable QWaitCondition factoryDone;
+
+        // Returns the number of objects added by the matching factories, including the ones in
+        // flight in other threads that have been waited for
+        template <class Predicate>
+        int materializeFactories(Predicate predicate, bool firstOnly) const;
+        void removeFactories(const ObjectPool::Id &id);
+
+        // Callbacks waiting for a matching object to be added
+        struct Waiter {
+            QPointer<QObject> context;
+            bool hasContext;
+            std::function<void(QObject *)> callback;
+            quint64 serial;
+        };
+        QHash<ObjectPool::Id, QList<Waiter>> idWaiters;
+        QHash<const QMetaObject *, QList<Waiter>> typeWaiters;
+        QHash<const char *, QList<Waiter>> interfaceWaiters;
+        quint64 waiterSerial = 0;
+        QAtomicInt waiterCount;
+        QMutex waiterLock;
+
+        void addWaiter(const ObjectPool::Id &id, const QMetaObject *metaObject, const char *iid,
+                       QObject *context, const std::function<void(QObject *)> &callback);
+        void notifyWaiters(const QList<QPair<ObjectPool::Id, QObject *>> &objs);
+        static void invokeWaiter(const Waiter &waiter, QObject *obj);
+
+        // Objects posted from other threads, a lock-free LIFO stack drained by the pool's thread.
+        // Only the address is kept, the poster guarantees that the object lives until it's added.
+        struct PostedNode {
+            ObjectPool::Id id;
+            QObject *obj;
+            PostedNode *next;
+        };
+        QAtomicPointer<PostedNode> postedHead;
+
+        void pushPosted(PostedNode *node);
+        void drainPosted();
+
+        // Statistics, only collected while the flag is set
+        QAtomicInt statisticsEnabled;
+        mutable QAtomicInteger<quint64> typedQueryCount;
+        mutable QAtomicInteger<quint64> scannedObjectCount;
+        mutable QAtomicInteger<quint64> readLockCount;
+        mutable QAtomicInteger<qint64> readLockWaitTime;
+        mutable QAtomicInteger<qint64> maxReadLockWaitTime;
+        mutable QAtomicInteger<quint64> writeLockCount;
+        mutable QAtomicInteger<qint64> writeLockHoldTime;
+        mutable QAtomicInteger<qint64> maxWriteLockHoldTime;
+        mutable QHash<ObjectPool::Id, quint64> idLookups;
+        mutable QHash<const QMetaObject *, quint64> typeLookups;
+        mutable QHash<const char *, quint64> interfaceLookups;
+        mutable QMutex statisticsLock;
+
+        static void recordLock(QAtomicInteger<quint64> &count, QAtomicInteger<qint64> &total,
+                               QAtomicInteger<qint64> &max, qint64 nsecs);
+        void recordIdLookup(const ObjectPool::Id &id) const;
+        void recordTypeLookup(const QMetaObject *metaObject, const char *iid, int scanned) const;
+
+        // The published snapshot or null, and an up to date one, both referenced
+        ObjectPoolSnapshotData *acquireSnapshot() const;
+        ObjectPoolSnapshotData *currentSnapshot() const;
+        void buildSnapshot(ObjectPoolSnapshotData &data) const;
+        void publishSnapshot(ObjectPoolSnapshotData *data) const;
+        static void releaseSnapshot(const ObjectPoolSnapshotData *data);
+
+        // Generation of the chain ending at this pool, bumped by any change of the pool or of its
+        // parent chain, a pool bumps the pools chained to it as well
+        QAtomicInteger<quint64> chainGeneration;
+        void touch();
+
+        QPointer<ObjectPool> parentPool;
+        QVector<ObjectPoolPrivate *> childPools;
+        QMutex childPoolsLock;
+
+        // Results of the chained lookups in a direct-mapped table, an entry is valid for the
+        // generation it was resolved in. Readers validate an entry by its sequence number and take
+        // no lock, the writers are serialized by the lock.
+        enum ChainLookup {
+            IdLookup = 1,
+            TypeLookup,
+            InterfaceLookup,
+        };
+        struct ChainCacheEntry {
+            QAtomicInteger<quint32> sequence; // odd while being written
+            QAtomicInteger<quint64> generation;
+            QAtomicInteger<quintptr> key;
+            QAtomicInt kind;
+            QAtomicPointer<QObject> obj;
+        };
+        static constexpr int ChainCacheSize = 64;
+        mutable ChainCacheEntry chainCache[ChainCacheSize];
+        mutable QMutex chainCacheLock;
+
+        template <class Func>
+        QObject *lookupChain(ChainLookup kind, quintptr key, Func find) const;
+
+        bool insertObject(const ObjectPool::Id &id, QObject *obj);
+        bool eraseObject(QObject *obj);
+        void commitBatch(const QList<QPair<ObjectPool::Id, QObject *>> &additions,
+                         const QList<QObject *> &removals,
+                         const QList<ObjectPool::Id> &idRemovals);
+
+        void objectAdded(const ObjectPool::Id &id, QObject *obj);
+        void aboutToRemoveObject(const ObjectPool::Id &id, QObject *obj);
+        void objectsAdded(const QList<QPair<ObjectPool::Id, QObject *>> &objs);
+        void aboutToRemoveObjects(const QList<QPair<ObjectPool::Id, QObject *>> &objs);
 
         friend class ObjectPool;
 
     private:
-        void _q_objectDestroyed();
+        void _q_objectDestroyed(QObject *obj);
     };
 
 
@@ -0,0 +1,280 @@
+#include <algorithm>
+
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QRandomGenerator>
+#include <QtWidgets/QApplication>
+
+#include <CoreApi/actiondomain.h>
+#include <CoreApi/private/actionextension_p.h>
+
+// Randomized differential test of the in place extension updates. Extensions are added and
+// removed in random order, after every step the catalog and the layouts of the domain are
+// compared with the ones of a domain built from scratch with the same extensions.
+
+using namespace Core;
+
+static QString menuId(int ext) {
+    return QStringLiteral("difftest.%1.menu").arg(ext);
+}
+
+static QString groupId(int ext) {
+    return QStringLiteral("difftest.%1.group").arg(ext);
+}
+
+static QString actionId(int ext, int i) {
+    return QStringLiteral("difftest.%1.action.%2").arg(ext).arg(i);
+}
+
+// Extension data built at run time, must outlive the domains
+struct TestExtension {
+    QVector<ActionObjectInfoData> objects;
+    QVector<ActionLayoutInfoEntry> entries;
+    QVector<int> roots;
+    QVector<ActionBuildRoutineData> routines;
+    ActionExtensionPrivate data;
+    ActionExtension extension{{&data}};
+
+    TestExtension() = default;
+    Q_DISABLE_COPY(TestExtension)
+
+    void addObject(const QString &id, ActionObjectInfo::Type type, ActionObjectInfo::Mode mode,
+                   const QByteArrayList &categories) {
+        objects.append({id, type, mode, categories.last(), {}, {}, categories});
+    }
+
+    int addEntry(const QString &id, ActionLayoutInfo::Type type,
+                 const QVector<int> &children = {}) {
+        entries.append({id, type, children});
+        return entries.size() - 1;
+    }
+
+    const ActionExtension *finish(const QString &hash) {
+        data.hash = hash;
+        data.version = QStringLiteral("1.0");
+        data.objectCount = objects.size();
+        data.objectData = objects.data();
+        data.layoutEntryCount = entries.size();
+        data.layoutEntryData = entries.data();
+        data.layoutRootCount = roots.size();
+        data.layoutRootData = roots.data();
+        data.buildRoutineCount = routines.size();
+        data.buildRoutineData = routines.data();
+        return &extension;
+    }
+};
+
+// A standalone menu with actions, a group and optionally the menu of a later extension, so that
+// the references never form a cycle. The build routines insert actions into the menus of the
+// other extensions, which may be absent.
+static const ActionExtension *createExtension(TestExtension &ext, int index, int count,
+                                              QRandomGenerator &rng) {
+    const QByteArray category = "DiffTest " + QByteArray::number(index);
+    const int actions = rng.bounded(1, 7);
+
+    ext.addObject(menuId(index), ActionObjectInfo::Menu, ActionObjectInfo::TopLevel,
+                  {category, "Menu"});
+    ext.addObject(groupId(index), ActionObjectInfo::Group, ActionObjectInfo::Plain,
+                  {category, "Group"});
+    for (int i = 0; i < actions; ++i) {
+        ext.addObject(actionId(index, i), ActionObjectInfo::Action, ActionObjectInfo::Plain,
+                      {category, "Actions", "Action " + QByteArray::number(i)});
+    }
+
+    QVector<int> children;
+    QVector<int> groupChildren;
+    for (int i = 0; i < actions; ++i) {
+        auto &list = rng.bounded(3) ? children : groupChildren;
+        list.append(ext.addEntry(actionId(index, i), ActionLayoutInfo::Action));
+    }
+    if (!groupChildren.isEmpty()) {
+        children.append(ext.addEntry({}, ActionLayoutInfo::Separator));
+        children.append(ext.addEntry(groupId(index), ActionLayoutInfo::Group, groupChildren));
+    }
+    if (index + 1 < count && rng.bounded(2)) {
+        children.append(ext.addEntry(menuId(rng.bounded(index + 1, count)),
+                                     rng.bounded(2) ? ActionLayoutInfo::Menu
+                                                    : ActionLayoutInfo::ExpandedMenu));
+    }
+    ext.roots.append(ext.addEntry(menuId(index), ActionLayoutInfo::Menu, children));
+
+    const int routines = count > 1 ? rng.bounded(3) : 0;
+    for (int r = 0; r < routines; ++r) {
+        int target = rng.bounded(count - 1);
+        if (target >= index)
+            target++;
+
+        static const ActionBuildRoutine::Anchor anchors[] = {
+            ActionBuildRoutine::Last,
+            ActionBuildRoutine::First,
+            ActionBuildRoutine::After,
+            ActionBuildRoutine::Before,
+        };
+        auto anchor = anchors[rng.bounded(4)];
+        ActionBuildRoutineData routine{anchor, menuId(target), {}, {}};
+        if (anchor == ActionBuildRoutine::After || anchor == ActionBuildRoutine::Before) {
+            routine.relativeTo = actionId(target, 0);
+        }
+        routine.entryIndexes.append(
+            ext.addEntry(actionId(index, rng.bounded(actions)), ActionLayoutInfo::Action));
+        ext.routines.append(routine);
+    }
+    return ext.finish(QStringLiteral("difftest.%1").arg(index));
+}
+
+static bool catalogEquals(const ActionCatalog &a, const ActionCatalog &b) {
+    if (a.name() != b.name() || a.id() != b.id())
+        return false;
+    const auto &children1 = a.children();
+    const auto &children2 = b.children();
+    if (children1.size() != children2.size())
+        return false;
+    for (int i = 0; i < children1.size(); ++i) {
+        if (!catalogEquals(children1.at(i), children2.at(i)))
+            return false;
+    }
+    return true;
+}
+
+static bool layoutEquals(const ActionLayout &a, const ActionLayout &b) {
+    if (a.id() != b.id() || a.type() != b.type())
+        return false;
+    const auto &children1 = a.children();
+    const auto &children2 = b.children();
+    if (children1.size() != children2.size())
+        return false;
+    for (int i = 0; i < children1.size(); ++i) {
+        if (!layoutEquals(children1.at(i), children2.at(i)))
+            return false;
+    }
+    return true;
+}
+
+static QString extensionNames(const QList<const ActionExtension *> &extensions) {
+    QStringList res;
+    for (const auto &ext : extensions) {
+        res.append(ext->hash());
+    }
+    return res.join(QStringLiteral(", "));
+}
+
+int main(int argc, char *argv[]) {
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        QStringLiteral("ChorusKit ActionDomain incremental update differential test"));
+    parser.addHelpOption();
+    QCommandLineOption seedOption(QStringLiteral("seed"), QStringLiteral("Random seed."),
+                                  QStringLiteral("value"), QStringLiteral("1"));
+    QCommandLineOption stepsOption(QStringLiteral("steps"),
+                                   QStringLiteral("Additions and removals."),
+                                   QStringLiteral("count"), QStringLiteral("1000"));
+    QCommandLineOption extensionsOption(QStringLiteral("extensions"),
+                                        QStringLiteral("Extensions to draw from."),
+                                        QStringLiteral("count"), QStringLiteral("12"));
+    parser.addOption(seedOption);
+    parser.addOption(stepsOption);
+    parser.addOption(extensionsOption);
+    parser.process(a);
+
+    const quint32 seed = parser.value(seedOption).toUInt();
+    const int steps = qMax(1, parser.value(stepsOption).toInt());
+    const int count = qMax(2, parser.value(extensionsOption).toInt());
+
+    QRandomGenerator rng(seed);
+    QVector<TestExtension *> data;
+    QList<const ActionExtension *> pool;
+    for (int i = 0; i < count; ++i) {
+        data.append(new TestExtension());
+        pool.append(createExtension(*data.back(), i, count, rng));
+    }
+
+    ActionDomain domain;
+    QList<const ActionExtension *> present; // in the order of the domain
+    const ActionExtension *lastAdded = nullptr;
+    int additions = 0;
+    int batchAdditions = 0;
+    int lastRemovals = 0;
+    int otherRemovals = 0;
+
+    int res = 0;
+    for (int step = 0; step < steps; ++step) {
+        QList<const ActionExtension *> absent;
+        for (const auto &ext : std::as_const(pool)) {
+            if (!present.contains(ext))
+                absent.append(ext);
+        }
+
+        QString operation;
+        if (!absent.isEmpty() && (present.isEmpty() || rng.bounded(2))) {
+            if (rng.bounded(4) == 0) {
+                // Several at once, the layout state is built from scratch
+                QList<const ActionExtension *> list;
+                const int n = rng.bounded(1, qMin(3, absent.size()) + 1);
+                for (int i = 0; i < n; ++i) {
+                    list.append(absent.takeAt(rng.bounded(absent.size())));
+                }
+                domain.addExtensions(list);
+                present += list;
+                lastAdded = nullptr;
+                batchAdditions++;
+                operation = QStringLiteral("addExtensions(%1)").arg(extensionNames(list));
+            } else {
+                auto ext = absent.at(rng.bounded(absent.size()));
+                domain.addExtension(ext);
+                present.append(ext);
+                lastAdded = ext;
+                additions++;
+                operation = QStringLiteral("addExtension(%1)").arg(ext->hash());
+            }
+        } else {
+            // The last added extension is taken back in place, any other one resets the state
+            const ActionExtension *ext = (lastAdded && rng.bounded(2))
+                                             ? lastAdded
+                                             : present.at(rng.bounded(present.size()));
+            domain.removeExtension(ext);
+            present.removeOne(ext);
+            if (ext == lastAdded) {
+                lastRemovals++;
+            } else {
+                otherRemovals++;
+            }
+            lastAdded = nullptr;
+            operation = QStringLiteral("removeExtension(%1)").arg(ext->hash());
+        }
+
+        ActionDomain full;
+        if (!present.isEmpty())
+            full.addExtensions(present);
+
+        const bool catalogOk = catalogEquals(domain.catalog(), full.catalog());
+        const auto layouts = domain.layouts();
+        const auto fullLayouts = full.layouts();
+        const bool layoutsOk = std::equal(layouts.begin(), layouts.end(), fullLayouts.begin(),
+                                          fullLayouts.end(), layoutEquals);
+        if (!catalogOk || !layoutsOk) {
+            fprintf(stderr, "step %d, seed %u: %s differs from a full build after %s\n", step,
+                    seed,
+                    !catalogOk ? (!layoutsOk ? "catalog and layouts" : "catalog") : "layouts",
+                    qPrintable(operation));
+            fprintf(stderr, "extensions: %s\n", qPrintable(extensionNames(present)));
+            res = 1;
+            break;
+        }
+    }
+
+    printf("seed %u: %d additions, %d batch additions, %d removals of the last extension, "
+           "%d other removals\n",
+           seed, additions, batchAdditions, lastRemovals, otherRemovals);
+
+    // The run must have exercised both removal paths
+    if (res == 0 && (lastRemovals == 0 || otherRemovals == 0)) {
+        fprintf(stderr, "seed %u: removal paths not covered, raise the steps\n", seed);
+        res = 1;
+    }
+
+    qDeleteAll(data);
+    return res;
+}
@@ -0,0 +1,337 @@
+#include <memory>
+#include <vector>
+
+#include <QtWidgets/QAction>
+#include <QtWidgets/QApplication>
+#include <QtWidgets/QMenu>
+#include <QtWidgets/QMenuBar>
+
+#include <CoreApi/actiondomain.h>
+#include <CoreApi/private/actionextension_p.h>
+
+#include <benchcommon.h>
+
+using namespace Core;
+
+using Bench::measure;
+using Bench::sink;
+
+static void report(const QString &name, int objects, qint64 iterations, qint64 nsecs) {
+    Bench::report(name, iterations, nsecs, {{"objects", objects}});
+}
+
+static QString menuBarId() {
+    return QStringLiteral("bench.menubar");
+}
+
+static QString menuId(int i) {
+    return QStringLiteral("bench.menu.%1").arg(i);
+}
+
+static QString actionId(int i) {
+    return QStringLiteral("bench.action.%1").arg(i);
+}
+
+static QString extraId(int i) {
+    return QStringLiteral("bench.extra.%1").arg(i);
+}
+
+// Extension data built at run time, must outlive the domain
+struct BenchExtension {
+    QVector<ActionObjectInfoData> objects;
+    QVector<ActionLayoutInfoEntry> entries;
+    QVector<int> roots;
+    QVector<ActionBuildRoutineData> routines;
+    ActionExtensionPrivate data;
+    ActionExtension extension{{&data}};
+
+    BenchExtension() = default;
+    Q_DISABLE_COPY(BenchExtension)
+
+    void addObject(const QString &id, ActionObjectInfo::Type type, ActionObjectInfo::Mode mode,
+                   const QByteArray &text) {
+        objects.append({id, type, mode, text, {}, {}, QByteArrayList{"Bench", text}});
+    }
+
+    int addEntry(const QString &id, ActionLayoutInfo::Type type,
+                 const QVector<int> &children = {}) {
+        entries.append({id, type, children});
+        return entries.size() - 1;
+    }
+
+    const ActionExtension *finish(const QString &hash) {
+        data.hash = hash;
+        data.version = QStringLiteral("1.0");
+        data.objectCount = objects.size();
+        data.objectData = objects.data();
+        data.layoutEntryCount = entries.size();
+        data.layoutEntryData = entries.data();
+        data.layoutRootCount = roots.size();
+        data.layoutRootData = roots.data();
+        data.buildRoutineCount = routines.size();
+        data.buildRoutineData = routines.data();
+        return &extension;
+    }
+};
+
+// A menu bar of standalone menus sharing the actions, every menu but the last of each ten also
+// refers to the next one, so that the layouts have to be sorted
+static const ActionExtension *createMainExtension(BenchExtension &ext, int objectCount,
+                                                  int menus) {
+    const int actions = qMax(menus, objectCount - menus - 1);
+    ext.addObject(menuBarId(), ActionObjectInfo::Menu, ActionObjectInfo::TopLevel, "Menu Bar");
+    for (int i = 0; i < menus; ++i) {
+        ext.addObject(menuId(i), ActionObjectInfo::Menu, ActionObjectInfo::TopLevel,
+                      "Menu " + QByteArray::number(i));
+    }
+    for (int i = 0; i < actions; ++i) {
+        ext.addObject(actionId(i), ActionObjectInfo::Action, ActionObjectInfo::Plain,
+                      "Action " + QByteArray::number(i));
+    }
+
+    QVector<int> menuBarChildren;
+    for (int m = 0; m < menus; ++m) {
+        QVector<int> children;
+        for (int a = m; a < actions; a += menus) {
+            children.append(ext.addEntry(actionId(a), ActionLayoutInfo::Action));
+        }
+        if (m % 10 != 9 && m + 1 < menus) {
+            children.append(ext.addEntry({}, ActionLayoutInfo::Separator));
+            children.append(ext.addEntry(menuId(m + 1), ActionLayoutInfo::Menu));
+        }
+        ext.roots.append(ext.addEntry(menuId(m), ActionLayoutInfo::Menu, children));
+        menuBarChildren.append(ext.addEntry(menuId(m), ActionLayoutInfo::Menu));
+    }
+    ext.roots.append(ext.addEntry(menuBarId(), ActionLayoutInfo::Menu, menuBarChildren));
+    return ext.finish(QStringLiteral("actionlayout_bench"));
+}
+
+// A few actions appended to the first menu by a build routine
+static const ActionExtension *createExtraExtension(BenchExtension &ext, int count) {
+    ActionBuildRoutineData routine{ActionBuildRoutine::Last, menuId(0), {}, {}};
+    for (int i = 0; i < count; ++i) {
+        ext.addObject(extraId(i), ActionObjectInfo::Action, ActionObjectInfo::Plain,
+                      "Extra " + QByteArray::number(i));
+        routine.entryIndexes.append(ext.addEntry(extraId(i), ActionLayoutInfo::Action));
+    }
+    ext.routines.append(routine);
+    return ext.finish(QStringLiteral("actionlayout_bench.extra"));
+}
+
+static int countNodes(const QList<ActionLayout> &layouts) {
+    int res = 0;
+    for (const auto &layout : layouts) {
+        res += 1 + countNodes(layout.children());
+    }
+    return res;
+}
+
+// Layouts of about the given number of nodes saved in both formats and restored, returns false
+// if a restore fails or changes the layouts
+static bool benchRestoreLayouts(int targetNodes, int menus, int iterations) {
+    // The node count grows linearly with the objects, one pass to measure the ratio
+    int objectCount = targetNodes;
+    for (int pass = 0; pass < 2; ++pass) {
+        BenchExtension data;
+        ActionDomain domain;
+        domain.addExtension(createMainExtension(data, objectCount, menus));
+        const int nodes = countNodes(domain.layouts());
+        if (pass == 0) {
+            objectCount = qMax(menus + 2, int(qint64(objectCount) * targetNodes / qMax(1, nodes)));
+            continue;
+        }
+
+        bool ok = true;
+        const auto layouts = domain.layouts();
+        for (auto format : {ActionDomain::XmlLayouts, ActionDomain::BinaryLayouts}) {
+            const bool xml = format == ActionDomain::XmlLayouts;
+            const auto saved = domain.saveLayouts(format);
+            report(xml ? "restoreLayouts(xml)" : "restoreLayouts(binary)",
+                   domain.objectIds().size(), iterations, measure([&]() {
+                       for (int i = 0; i < iterations; ++i) {
+                           ok &= domain.restoreLayouts(saved);
+                       }
+                   }));
+            Bench::annotate({{"nodes", nodes}, {"bytes", saved.size()}});
+            ok &= countNodes(domain.layouts()) == nodes &&
+                  domain.saveLayouts(format) == saved;
+        }
+        if (!ok) {
+            fprintf(stderr, "restoreLayouts: failed for %d nodes\n", nodes);
+        }
+        return ok && countNodes(layouts) == nodes;
+    }
+    return false;
+}
+
+// Extensions of a menu each, added at once or one by one to an empty domain. Batches of 4096
+// objects or more are validated in the thread pool. Returns false if the domains end up with
+// different objects.
+static bool benchAddExtensions(int objectCount, int extensionCount, int iterations) {
+    const int actions = qMax(1, objectCount / extensionCount - 1);
+    std::vector<std::unique_ptr<BenchExtension>> data;
+    QList<const ActionExtension *> extensions;
+    for (int e = 0; e < extensionCount; ++e) {
+        auto &ext = *data.emplace_back(new BenchExtension());
+        const auto prefix = QStringLiteral("bench.batch.%1.").arg(e);
+        const auto text = "Batch " + QByteArray::number(e);
+        ext.addObject(prefix + QStringLiteral("menu"), ActionObjectInfo::Menu,
+                      ActionObjectInfo::TopLevel, text);
+        QVector<int> children;
+        for (int i = 0; i < actions; ++i) {
+            auto id = prefix + QString::number(i);
+            ext.addObject(id, ActionObjectInfo::Action, ActionObjectInfo::Plain,
+                          text + " Action " + QByteArray::number(i));
+            children.append(ext.addEntry(id, ActionLayoutInfo::Action));
+        }
+        ext.roots.append(ext.addEntry(prefix + QStringLiteral("menu"), ActionLayoutInfo::Menu,
+                                      children));
+        extensions.append(ext.finish(QStringLiteral("actionlayout_bench.batch.%1").arg(e)));
+    }
+
+    const int objects = extensionCount * (actions + 1);
+    const QJsonObject fields = {{"objects", objects}, {"extensions", extensionCount}};
+    int batchedObjects = 0;
+    int sequentialObjects = 0;
+    auto run = [&](const QString &name, bool batched, bool withLayouts, int &resultObjects) {
+        Bench::report(name, iterations, measure([&]() {
+                          qint64 n = 0;
+                          for (int i = 0; i < iterations; ++i) {
+                              ActionDomain domain;
+                              if (batched) {
+                                  domain.addExtensions(extensions);
+                              } else {
+                                  for (const auto &ext : std::as_const(extensions)) {
+                                      domain.addExtension(ext);
+                                  }
+                              }
+                              if (withLayouts)
+                                  n += domain.layouts().size();
+                              resultObjects = domain.objectIds().size();
+                          }
+                          sink += n;
+                      }),
+                      fields);
+    };
+    run(QStringLiteral("addExtensions(batched)"), true, false, batchedObjects);
+    run(QStringLiteral("addExtension(sequential)"), false, false, sequentialObjects);
+    run(QStringLiteral("addExtensions(batched)+layouts"), true, true, batchedObjects);
+    run(QStringLiteral("addExtension(sequential)+layouts"), false, true, sequentialObjects);
+    return batchedObjects == objects && sequentialObjects == objects;
+}
+
+// Returns false if the layouts or the builds come out empty
+static bool benchLayouts(int objectCount, int menus, int iterations) {
+    BenchExtension mainData;
+    BenchExtension extraData;
+    auto mainExt = createMainExtension(mainData, objectCount, menus);
+    auto extraExt = createExtraExtension(extraData, 10);
+
+    ActionDomain domain;
+    domain.addExtension(mainExt);
+    domain.addExtension(extraExt);
+    const int objects = domain.objectIds().size();
+
+    // Adding several extensions at once drops the layout state, the layouts are built from
+    // scratch and sorted
+    report("layouts(full build)", objects, iterations, measure([&]() {
+               qint64 n = 0;
+               for (int i = 0; i < iterations; ++i) {
+                   domain.removeExtension(extraExt);
+                   domain.addExtensions({extraExt});
+                   n += domain.layouts().size();
+               }
+               sink += n;
+           }));
+
+    // The last extension is taken back and applied again in place, the layouts are converted
+    // and sorted again
+    domain.removeExtension(extraExt);
+    domain.addExtension(extraExt);
+    report("layouts(in place)", objects, iterations, measure([&]() {
+               qint64 n = 0;
+               for (int i = 0; i < iterations; ++i) {
+                   domain.removeExtension(extraExt);
+                   domain.addExtension(extraExt);
+                   n += domain.layouts().size();
+               }
+               sink += n;
+           }));
+
+    const auto layouts = domain.layouts();
+    report("setLayouts", objects, iterations, measure([&]() {
+               for (int i = 0; i < iterations; ++i) {
+                   domain.setLayouts(layouts);
+               }
+           }));
+    bool ok = domain.layouts().size() == layouts.size() && !layouts.isEmpty();
+
+    // The menus are created by the default factory
+    auto menuBar = new QMenuBar();
+    QObject holder;
+    QList<ActionItem *> items;
+    items.append(new ActionItem(menuBarId(), menuBar));
+    for (const auto &obj : std::as_const(mainData.objects)) {
+        if (obj.type == ActionObjectInfo::Action)
+            items.append(new ActionItem(obj.id, new QAction(&holder)));
+    }
+    for (const auto &obj : std::as_const(extraData.objects)) {
+        items.append(new ActionItem(obj.id, new QAction(&holder)));
+    }
+    const ActionItem::MenuFactory menuFactory([](QWidget *parent) {
+        return new QMenu(parent); //
+    });
+
+    ActionDomain::BuildStatistics statistics;
+    ok &= domain.buildLayouts(items, menuFactory, &statistics) && statistics.insertedActions > 0;
+
+    // The plan is compiled again after the layouts are set
+    report("buildLayouts(compile)", objects, iterations, measure([&]() {
+               for (int i = 0; i < iterations; ++i) {
+                   domain.setLayouts(layouts);
+                   domain.buildLayouts(items, menuFactory);
+               }
+           }));
+    report("buildLayouts", objects, iterations, measure([&]() {
+               for (int i = 0; i < iterations; ++i) {
+                   domain.buildLayouts(items, menuFactory);
+               }
+           }));
+
+    qDeleteAll(items);
+    delete menuBar;
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication a(argc, argv);
+
+    Bench::CommandLine cmd(QStringLiteral("ChorusKit ActionDomain layouts benchmark"));
+    cmd.addSizesOption(QStringLiteral("1000,10000"));
+    auto menusOption = cmd.addOption(QStringLiteral("menus"),
+                                     QStringLiteral("Standalone menus sharing the actions."),
+                                     QStringLiteral("count"), QStringLiteral("100"));
+    auto nodesOption = cmd.addOption(QStringLiteral("restore-nodes"),
+                                     QStringLiteral("Layout nodes saved and restored."),
+                                     QStringLiteral("count"), QStringLiteral("5000"));
+    auto extensionsOption = cmd.addOption(QStringLiteral("extensions"),
+                                          QStringLiteral("Extensions added at once or in turn."),
+                                          QStringLiteral("count"), QStringLiteral("40"));
+    auto iterationsOption = cmd.addOption(QStringLiteral("iterations"),
+                                          QStringLiteral("Iterations of each operation."),
+                                          QStringLiteral("count"), QStringLiteral("10"));
+    cmd.process(a);
+
+    const int menus = cmd.intValue(menusOption);
+    const int extensions = cmd.intValue(extensionsOption);
+    const int iterations = cmd.intValue(iterationsOption);
+
+    bool ok = benchRestoreLayouts(cmd.intValue(nodesOption), menus, iterations);
+    for (int size : cmd.sizes()) {
+        ok &= benchLayouts(size, menus, iterations);
+        ok &= benchAddExtensions(size, extensions, iterations);
+    }
+    return cmd.write(QStringLiteral("actionlayout"), ok, {{"menus", menus}});
+}
@@ -0,0 +1,155 @@
+#include <iterator>
+
+#include <QtCore/QCoreApplication>
+
+#include <CoreApi/actionsearchindex.h>
+
+#include <benchcommon.h>
+
+using Core::ActionSearchIndex;
+
+using Bench::measure;
+
+static void report(const QString &name, int objects, qint64 iterations, qint64 nsecs) {
+    Bench::report(name, iterations, nsecs, {{"objects", objects}});
+}
+
+static const char *const verbs[] = {
+    "Open",   "Save",  "Close",  "Export",   "Import", "Select", "Delete", "Insert",
+    "Toggle", "Show",  "Hide",   "Transpose", "Split", "Merge",  "Quantize", "Render",
+};
+static const char *const nouns[] = {
+    "File",  "Project", "Track", "Clip",     "Note",    "Tempo",   "Marker",  "Region",
+    "Mixer", "Plugin",  "Lyric", "Phoneme",  "Pattern", "Channel", "Envelope", "Score",
+};
+static const char *const categories[] = {
+    "File", "Edit", "View", "Playback", "Tools", "Window", "Help", "Track",
+};
+
+struct Object {
+    QString id;
+    QStringList texts;
+};
+
+// Texts like "Open Track 42" with categories like "Edit Track" and a camel case command class
+static QVector<Object> createObjects(int count) {
+    QVector<Object> objs;
+    objs.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        QString verb = QString::fromLatin1(verbs[i % std::size(verbs)]);
+        QString noun = QString::fromLatin1(nouns[(i / std::size(verbs)) % std::size(nouns)]);
+        QString category = QString::fromLatin1(categories[i % std::size(categories)]);
+        int serial = i / int(std::size(verbs) * std::size(nouns));
+        objs.append({
+            QStringLiteral("bench.action.%1").arg(i),
+            {
+                QStringLiteral("&%1 %2 %3...").arg(verb, noun).arg(serial),
+                QStringLiteral("%1 %2").arg(category, noun),
+                QStringLiteral("%1%2Command").arg(verb, noun),
+            },
+        });
+    }
+    return objs;
+}
+
+// Searches slower than the target per query fail the run up to the reference size, above it
+// they are only flagged
+static const int TARGET_OBJECTS = 20000;
+
+static bool benchIndex(int count, int queries, qint64 targetNs) {
+    const auto objs = createObjects(count);
+    ActionSearchIndex index;
+
+    report("insert", count, count, measure([&]() {
+               for (const auto &obj : objs) {
+                   index.insert(obj.id, obj.texts);
+               }
+           }));
+
+    const QStringList patterns = {
+        QStringLiteral("o"),                // initials
+        QStringLiteral("tra"),              // substring, common
+        QStringLiteral("transpose note"),   // substring, several words
+        QStringLiteral("quantize clip 7"),  // substring, selective
+        QStringLiteral("otr"),              // fuzzy
+        QStringLiteral("exp env"),          // fuzzy, several words
+        QStringLiteral("splitlyric"),       // camel case command class
+        QStringLiteral("zzz"),              // no match
+    };
+    bool ok = true;
+    for (const auto &pattern : patterns) {
+        auto nsecs = measure([&]() {
+            qint64 n = 0;
+            for (int i = 0; i < queries; ++i) {
+                n += index.search(pattern).size();
+            }
+            Bench::sink += n;
+        });
+        report(QStringLiteral("search(\"%1\")").arg(pattern), count, queries, nsecs);
+
+        bool withinTarget = nsecs / queries <= targetNs;
+        Bench::annotate({{"targetNs", double(targetNs)}, {"withinTarget", withinTarget}});
+        if (!withinTarget && count <= TARGET_OBJECTS) {
+            fprintf(stderr, "search: \"%s\" takes %lld ns per query at %d objects\n",
+                    qPrintable(pattern), nsecs / queries, count);
+            ok = false;
+        }
+    }
+
+    // The best match of a full text is the object itself
+    for (int i = 0; i < count; i += qMax(1, count / 100)) {
+        auto res = index.search(objs.at(i).texts.front(), 1);
+        if (res.isEmpty() || res.front().id != objs.at(i).id) {
+            fprintf(stderr, "search: %s not found by its text\n", qPrintable(objs.at(i).id));
+            ok = false;
+            break;
+        }
+    }
+    if (index.search(QStringLiteral("otr")).isEmpty() ||
+        !index.search(QStringLiteral("zzz")).isEmpty()) {
+        fprintf(stderr, "search: unexpected fuzzy matches\n");
+        ok = false;
+    }
+
+    // Incremental updates, as when an extension is removed and added back
+    const int batch = qMax(1, count / 10);
+    report("remove", count, batch, measure([&]() {
+               for (int i = 0; i < batch; ++i) {
+                   index.remove(objs.at(i).id);
+               }
+           }));
+    ok &= index.size() == count - batch;
+    report("reinsert", count, batch, measure([&]() {
+               for (int i = 0; i < batch; ++i) {
+                   index.insert(objs.at(i).id, objs.at(i).texts);
+               }
+           }));
+    ok &= index.size() == count;
+
+    Bench::annotate({{"ok", ok}});
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+
+    Bench::CommandLine cmd(QStringLiteral("ChorusKit ActionSearchIndex benchmark"));
+    cmd.addSizesOption(QStringLiteral("1000,10000,20000"));
+    auto queriesOption = cmd.addOption(QStringLiteral("queries"),
+                                       QStringLiteral("Iterations of each search."),
+                                       QStringLiteral("count"), QStringLiteral("1000"));
+    auto targetOption = cmd.addOption(
+        QStringLiteral("target"),
+        QStringLiteral("Time per query not to exceed at %1 objects.").arg(TARGET_OBJECTS),
+        QStringLiteral("ns"), QStringLiteral("1000000"));
+    cmd.process(a);
+
+    const int queries = cmd.intValue(queriesOption);
+    const int targetNs = cmd.intValue(targetOption);
+
+    bool ok = true;
+    for (int size : cmd.sizes()) {
+        ok &= benchIndex(size, queries, targetNs);
+    }
+    return cmd.write(QStringLiteral("actionsearch"), ok);
+}
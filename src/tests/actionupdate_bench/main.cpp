@@ -0,0 +1,206 @@
+#include <QtCore/QTemporaryDir>
+#include <QtCore/QTranslator>
+#include <QtGui/QColor>
+#include <QtGui/QImage>
+#include <QtWidgets/QApplication>
+#include <QtWidgets/QMainWindow>
+#include <QtWidgets/QMenuBar>
+#include <QtWidgets/QToolBar>
+
+#include <CoreApi/actiondomain.h>
+#include <CoreApi/private/actionextension_p.h>
+
+#include <benchcommon.h>
+
+using namespace Core;
+
+static void report(const QString &name, int items, qint64 iterations, qint64 nsecs,
+                   qint64 notifications) {
+    double changed = iterations > 0 ? double(notifications) / double(iterations) : 0.0;
+    Bench::report(name, iterations, nsecs, {{"items", items}, {"changedPerOp", changed}});
+}
+
+// Translates the action texts differently in each generation, as switching between languages
+class BenchTranslator : public QTranslator {
+public:
+    int generation = 0;
+
+    bool isEmpty() const override {
+        return false;
+    }
+
+    QString translate(const char *context, const char *sourceText, const char *disambiguation,
+                      int n) const override {
+        Q_UNUSED(disambiguation);
+        Q_UNUSED(n);
+        if (generation == 0 || qstrcmp(context, "ChorusKit::ActionText") != 0)
+            return {};
+        return QStringLiteral("[%1] %2").arg(generation).arg(QString::fromUtf8(sourceText));
+    }
+};
+
+struct Session {
+    QList<QMainWindow *> windows;
+    QList<ActionItem *> items;
+    qint64 notifications = 0;
+
+    ~Session() {
+        qDeleteAll(items);
+        qDeleteAll(windows);
+    }
+};
+
+static QString actionId(int i) {
+    return QStringLiteral("bench.action.%1").arg(i);
+}
+
+static QString menuId(int i) {
+    return QStringLiteral("bench.menu.%1").arg(i);
+}
+
+// Objects of the actions and menus, the data must outlive the domain
+static const ActionExtension *createExtension(int menus, int actionsPerMenu) {
+    static QVector<ActionObjectInfoData> objectData;
+    static ActionExtensionPrivate data;
+    static ActionExtension extension{{&data}};
+
+    auto add = [](const QString &id, ActionObjectInfo::Type type, const QByteArray &text) {
+        objectData.append({id, type, ActionObjectInfo::Plain, text, {}, {},
+                           QByteArrayList{"Bench", text}});
+    };
+    for (int i = 0; i < menus; ++i) {
+        add(menuId(i), ActionObjectInfo::Menu, "Menu " + QByteArray::number(i));
+    }
+    for (int i = 0; i < menus * actionsPerMenu; ++i) {
+        add(actionId(i), ActionObjectInfo::Action, "Action " + QByteArray::number(i));
+    }
+
+    data.hash = QStringLiteral("actionupdate_bench");
+    data.version = QStringLiteral("1.0");
+    data.objectCount = objectData.size();
+    data.objectData = objectData.data();
+    data.layoutEntryCount = 0;
+    data.layoutEntryData = nullptr;
+    data.layoutRootCount = 0;
+    data.layoutRootData = nullptr;
+    data.buildRoutineCount = 0;
+    data.buildRoutineData = nullptr;
+    return &extension;
+}
+
+// Windows with a menu bar of menus and a tool bar of the first actions of each menu
+static void createSession(Session &session, int windows, int menus, int actionsPerMenu) {
+    for (int w = 0; w < windows; ++w) {
+        auto win = new QMainWindow();
+        auto toolBar = win->addToolBar(QStringLiteral("Tools"));
+        for (int m = 0; m < menus; ++m) {
+            auto menuItem = new ActionItem(
+                menuId(m), ActionItem::MenuFactory([](QWidget *parent) {
+                    return new QMenu(parent); //
+                }));
+            session.items.append(menuItem);
+            auto menu = menuItem->requestMenu(win->menuBar());
+            win->menuBar()->addMenu(menu);
+            QObject::connect(menu->menuAction(), &QAction::changed,
+                             [&session]() { session.notifications++; });
+
+            for (int a = 0; a < actionsPerMenu; ++a) {
+                auto action = new QAction(win);
+                QObject::connect(action, &QAction::changed,
+                                 [&session]() { session.notifications++; });
+                session.items.append(new ActionItem(actionId(m * actionsPerMenu + a), action));
+                menu->addAction(action);
+                if (a < 4)
+                    toolBar->addAction(action);
+            }
+        }
+        win->show();
+        session.windows.append(win);
+    }
+}
+
+template <class Func>
+static void measure(const QString &name, Session &session, int iterations, Func func) {
+    QApplication::processEvents();
+    session.notifications = 0;
+
+    // The repaints and relayouts of the windows are part of the cost
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < iterations; ++i) {
+        func(i);
+        QApplication::processEvents();
+    }
+    report(name, session.items.size(), iterations, timer.nsecsElapsed(), session.notifications);
+}
+
+int main(int argc, char *argv[]) {
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication a(argc, argv);
+
+    Bench::CommandLine cmd(
+        QStringLiteral("ChorusKit ActionDomain updateTexts/updateIcons benchmark"));
+    auto windowsOption =
+        cmd.addOption(QStringLiteral("windows"), QStringLiteral("Windows in the session."),
+                      QStringLiteral("count"), QStringLiteral("5"));
+    auto menusOption =
+        cmd.addOption(QStringLiteral("menus"), QStringLiteral("Menus of each window."),
+                      QStringLiteral("count"), QStringLiteral("10"));
+    auto actionsOption =
+        cmd.addOption(QStringLiteral("actions"), QStringLiteral("Actions of each menu."),
+                      QStringLiteral("count"), QStringLiteral("30"));
+    auto iterationsOption =
+        cmd.addOption(QStringLiteral("iterations"), QStringLiteral("Switches of each kind."),
+                      QStringLiteral("count"), QStringLiteral("20"));
+    cmd.process(a);
+
+    const int windows = cmd.intValue(windowsOption);
+    const int menus = cmd.intValue(menusOption);
+    const int actionsPerMenu = cmd.intValue(actionsOption);
+    const int iterations = cmd.intValue(iterationsOption);
+
+    // Two themes of distinct icon files
+    QTemporaryDir iconDir;
+    if (!iconDir.isValid()) {
+        fprintf(stderr, "%s: failed to create temporary directory\n",
+                qPrintable(QCoreApplication::applicationName()));
+        return -1;
+    }
+    ActionDomain domain;
+    domain.addExtension(createExtension(menus, actionsPerMenu));
+    const QStringList themes = {QStringLiteral("light"), QStringLiteral("dark")};
+    for (int t = 0; t < themes.size(); ++t) {
+        for (int i = 0; i < menus * actionsPerMenu; ++i) {
+            QImage image(16, 16, QImage::Format_ARGB32);
+            image.fill(QColor::fromHsv((i * 7) % 360, 200, t ? 80 : 220));
+            auto fileName = iconDir.filePath(QStringLiteral("%1-%2.png").arg(themes.at(t)).arg(i));
+            image.save(fileName);
+            domain.addIcon(themes.at(t), actionId(i), fileName);
+        }
+    }
+
+    BenchTranslator translator;
+    QCoreApplication::installTranslator(&translator);
+
+    Session session;
+    createSession(session, windows, menus, actionsPerMenu);
+    domain.updateTexts(session.items);
+    domain.updateIcons(themes.front(), session.items);
+
+    measure("updateTexts(unchanged)", session, iterations,
+            [&](int) { domain.updateTexts(session.items); });
+    measure("updateTexts(language switch)", session, iterations, [&](int) {
+        translator.generation++;
+        domain.updateTexts(session.items);
+    });
+    measure("updateIcons(unchanged)", session, iterations,
+            [&](int) { domain.updateIcons(themes.front(), session.items); });
+    measure("updateIcons(theme switch)", session, iterations, [&](int i) {
+        domain.updateIcons(themes.at((i + 1) % themes.size()), session.items); //
+    });
+
+    QCoreApplication::removeTranslator(&translator);
+
+    return cmd.write(QStringLiteral("actionupdate"), true, {{"windows", windows}});
+}
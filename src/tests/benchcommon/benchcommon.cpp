@@ -0,0 +1,109 @@
+#include "benchcommon.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFile>
+#include <QtCore/QJsonDocument>
+
+namespace Bench {
+
+    std::atomic<qint64> sink;
+
+    static QJsonArray &resultList() {
+        static QJsonArray list;
+        return list;
+    }
+
+    void report(const QString &name, qint64 iterations, qint64 nsecs, const QJsonObject &fields) {
+        QJsonObject obj = fields;
+        obj.insert("name", name);
+        obj.insert("iterations", double(iterations));
+        obj.insert("totalNs", double(nsecs));
+        obj.insert("nsPerOp", iterations > 0 ? double(nsecs) / double(iterations) : 0.0);
+        resultList().append(obj);
+    }
+
+    void annotate(const QJsonObject &fields) {
+        auto &list = resultList();
+        if (list.isEmpty())
+            return;
+        auto last = list.last().toObject();
+        for (auto it = fields.begin(); it != fields.end(); ++it) {
+            last.insert(it.key(), it.value());
+        }
+        list.replace(list.size() - 1, last);
+    }
+
+    QJsonArray results() {
+        return resultList();
+    }
+
+    CommandLine::CommandLine(const QString &description)
+        : m_outputOption(QStringLiteral("o")), m_sizesOption(QStringLiteral("sizes")) {
+        parser.setApplicationDescription(description);
+        parser.addHelpOption();
+
+        m_outputOption.setDescription(QStringLiteral("Write output to file rather than stdout."));
+        m_outputOption.setValueName(QStringLiteral("file"));
+        parser.addOption(m_outputOption);
+    }
+
+    QCommandLineOption CommandLine::addOption(const QString &name, const QString &description,
+                                              const QString &valueName,
+                                              const QString &defaultValue) {
+        QCommandLineOption option(name);
+        option.setDescription(description);
+        option.setValueName(valueName);
+        option.setDefaultValue(defaultValue);
+        parser.addOption(option);
+        return option;
+    }
+
+    void CommandLine::addSizesOption(const QString &defaultValue, const QString &description) {
+        m_sizesOption.setDescription(description);
+        m_sizesOption.setValueName(QStringLiteral("list"));
+        m_sizesOption.setDefaultValue(defaultValue);
+        parser.addOption(m_sizesOption);
+    }
+
+    void CommandLine::process(const QCoreApplication &app) {
+        parser.process(app);
+    }
+
+    QList<int> CommandLine::sizes() const {
+        QList<int> res;
+        for (const auto &item : parser.value(m_sizesOption).split(',', Qt::SkipEmptyParts)) {
+            int size = item.trimmed().toInt();
+            if (size > 0) {
+                res.append(size);
+            }
+        }
+        return res;
+    }
+
+    int CommandLine::intValue(const QCommandLineOption &option, int min) const {
+        return qMax(min, parser.value(option).toInt());
+    }
+
+    int CommandLine::write(const QString &benchmark, bool ok, const QJsonObject &fields) const {
+        QJsonObject doc = fields;
+        doc.insert("benchmark", benchmark);
+        doc.insert("qtVersion", qVersion());
+        doc.insert("ok", ok);
+        doc.insert("results", resultList());
+        auto data = QJsonDocument(doc).toJson(QJsonDocument::Indented);
+
+        if (parser.isSet(m_outputOption)) {
+            QFile file(parser.value(m_outputOption));
+            if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                fprintf(stderr, "%s: failed to create output file\n",
+                        qPrintable(QCoreApplication::applicationName()));
+                return -1;
+            }
+            file.write(data);
+        } else {
+            fwrite(data.constData(), 1, size_t(data.size()), stdout);
+        }
+        return ok ? 0 : 1;
+    }
+
+}
@@ -0,0 +1,63 @@
+#ifndef BENCHCOMMON_H
+#define BENCHCOMMON_H
+
+#include <atomic>
+
+#include <QtCore/QCommandLineOption>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonObject>
+
+namespace Bench {
+
+    // Keeps the results of the measured operations from being optimized out
+    extern std::atomic<qint64> sink;
+
+    template <class Func>
+    inline qint64 measure(Func func) {
+        QElapsedTimer timer;
+        timer.start();
+        func();
+        return timer.nsecsElapsed();
+    }
+
+    // Appends a result with the time per operation, the fields are added to it
+    void report(const QString &name, qint64 iterations, qint64 nsecs,
+                const QJsonObject &fields = {});
+
+    // Adds fields to the last result
+    void annotate(const QJsonObject &fields);
+
+    QJsonArray results();
+
+    // Command line of the benchmarks, the results are written as JSON to stdout or to the file
+    // of the -o option
+    class CommandLine {
+    public:
+        explicit CommandLine(const QString &description);
+
+        QCommandLineOption addOption(const QString &name, const QString &description,
+                                     const QString &valueName, const QString &defaultValue);
+        void addSizesOption(const QString &defaultValue,
+                            const QString &description = QStringLiteral(
+                                "Comma separated object counts."));
+
+        void process(const QCoreApplication &app);
+
+        QList<int> sizes() const;
+        int intValue(const QCommandLineOption &option, int min = 1) const;
+
+        // Returns the exit code, 0 if ok, 1 if not, -1 if the output file can't be written
+        int write(const QString &benchmark, bool ok, const QJsonObject &fields = {}) const;
+
+        QCommandLineParser parser;
+
+    private:
+        QCommandLineOption m_outputOption;
+        QCommandLineOption m_sizesOption;
+    };
+
+}
+
+#endif // BENCHCOMMON_H
@@ -0,0 +1,31 @@
+#ifndef BENCHOBJECTS_H
+#define BENCHOBJECTS_H
+
+#include <QtCore/QObject>
+
+class BenchObject : public QObject {
+    Q_OBJECT
+public:
+    explicit BenchObject(int value, QObject *parent = nullptr) : QObject(parent), value(value) {
+    }
+
+    int value;
+};
+
+class BenchDerivedObject : public BenchObject {
+    Q_OBJECT
+public:
+    explicit BenchDerivedObject(int value, QObject *parent = nullptr)
+        : BenchObject(value, parent) {
+    }
+};
+
+// Makes up a small fraction of the pool
+class BenchRareObject : public BenchObject {
+    Q_OBJECT
+public:
+    explicit BenchRareObject(int value, QObject *parent = nullptr) : BenchObject(value, parent) {
+    }
+};
+
+#endif // BENCHOBJECTS_H
@@ -0,0 +1,614 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFile>
+#include <QtCore/QThread>
+
+#ifdef Q_OS_LINUX
+#  include <unistd.h>
+#endif
+
+#include <CoreApi/objectpool.h>
+
+#include <benchcommon.h>
+
+#include "benchobjects.h"
+
+using Core::ObjectPool;
+
+using Bench::measure;
+using Bench::sink;
+
+static const int ID_COUNT = 100;
+
+static void report(const QString &name, int objects, qint64 iterations, qint64 nsecs,
+                   int threads = 1) {
+    Bench::report(name, iterations, nsecs, {{"objects", objects}, {"threads", threads}});
+}
+
+static QList<QObject *> createObjects(int count) {
+    QList<QObject *> objs;
+    objs.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        if (i % 2) {
+            objs.append(new BenchDerivedObject(i));
+        } else {
+            objs.append(new BenchObject(i));
+        }
+    }
+    return objs;
+}
+
+// Resident set size in bytes, -1 if unknown
+static qint64 residentBytes() {
+#ifdef Q_OS_LINUX
+    QFile file(QStringLiteral("/proc/self/statm"));
+    if (file.open(QIODevice::ReadOnly)) {
+        const auto fields = file.readAll().split(' ');
+        if (fields.size() > 1)
+            return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE);
+    }
+#endif
+    return -1;
+}
+
+static QList<ObjectPool::Id> createIds() {
+    QList<ObjectPool::Id> ids;
+    for (int i = 0; i < ID_COUNT; ++i) {
+        ids.append(ObjectPool::Id(QString("bench.id.%1").arg(i)));
+    }
+    return ids;
+}
+
+static void benchSingleThread(int count, int lookups) {
+    const auto ids = createIds();
+    const auto objs = createObjects(count);
+    ObjectPool pool;
+
+    report("addObject", count, count, measure([&]() {
+               for (int i = 0; i < count; ++i) {
+                   pool.addObject(ids.at(i % ID_COUNT), objs.at(i));
+               }
+           }));
+
+    report("getObjects(id)", count, lookups, measure([&]() {
+               qint64 n = 0;
+               for (int i = 0; i < lookups; ++i) {
+                   n += pool.getObjects(ids.at(i % ID_COUNT)).size();
+               }
+               sink += n;
+           }));
+
+    report("getObjects(QString)", count, lookups, measure([&]() {
+               qint64 n = 0;
+               for (int i = 0; i < lookups; ++i) {
+                   n += pool.getObjects(QStringLiteral("bench.id.0")).size();
+               }
+               sink += n;
+           }));
+
+    // Typed queries return O(n) results, scale the iterations down to keep runs short
+    const int typedLookups = qMax(10, int(qint64(lookups) * 1000 / count));
+
+    report("getObjects<T>()", count, typedLookups, measure([&]() {
+               qint64 n = 0;
+               for (int i = 0; i < typedLookups; ++i) {
+                   n += pool.getObjects<BenchDerivedObject>().size();
+               }
+               sink += n;
+           }));
+
+    report("getObjects<T>(predicate)", count, typedLookups, measure([&]() {
+               qint64 n = 0;
+               for (int i = 0; i < typedLookups; ++i) {
+                   n += pool.getObjects<BenchObject>([](BenchObject *obj) {
+                                 return obj->value % 10 == 0; //
+                             })
+                            .size();
+               }
+               sink += n;
+           }));
+
+    report("getFirstObject<T>(predicate)", count, typedLookups, measure([&]() {
+               qint64 n = 0;
+               const int last = count - 1;
+               for (int i = 0; i < typedLookups; ++i) {
+                   n += pool.getFirstObject<BenchObject>([last](BenchObject *obj) {
+                       return obj->value == last; //
+                   }) != nullptr;
+               }
+               sink += n;
+           }));
+
+    report("forEachObject<T>()", count, typedLookups, measure([&]() {
+               qint64 n = 0;
+               for (int i = 0; i < typedLookups; ++i) {
+                   pool.forEachObject<BenchDerivedObject>([&n](BenchDerivedObject *obj) {
+                       n += obj->value; //
+                   });
+               }
+               sink += n;
+           }));
+
+    report("getFirstObject<T>()", count, lookups, measure([&]() {
+               qint64 n = 0;
+               for (int i = 0; i < lookups; ++i) {
+                   n += pool.getFirstObject<BenchDerivedObject>() != nullptr;
+               }
+               sink += n;
+           }));
+
+    // Remove half of the objects one by one, the rest by id
+    report("removeObject", count, count / 2, measure([&]() {
+               for (int i = 0; i < count; i += 2) {
+                   pool.removeObject(objs.at(i));
+               }
+           }));
+
+    report("removeObjects(id)", count, ID_COUNT, measure([&]() {
+               for (const auto &id : ids) {
+                   pool.removeObjects(id);
+               }
+           }));
+
+    qDeleteAll(objs);
+}
+
+// The readers query the pool, or the snapshot published by the writer if snapshots is true
+static void benchContention(int count, int readers, int durationMs, bool snapshots) {
+    const auto ids = createIds();
+    const auto objs = createObjects(count);
+    const auto extraObjs = createObjects(ID_COUNT);
+
+    ObjectPool pool;
+    {
+        ObjectPool::Batch batch(&pool);
+        for (int i = 0; i < count; ++i) {
+            batch.addObject(ids.at(i % ID_COUNT), objs.at(i));
+        }
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<qint64> readOps{0};
+    std::atomic<qint64> writeOps{0};
+
+    std::vector<std::thread> threads;
+    for (int r = 0; r < readers; ++r) {
+        threads.emplace_back([&, r]() {
+            qint64 n = 0;
+            qint64 found = 0;
+            for (int i = r; !stop.load(std::memory_order_relaxed); ++i, ++n) {
+                if (snapshots) {
+                    const auto snapshot = pool.snapshot();
+                    if (i % 2) {
+                        found += snapshot.getObjects(ids.at(i % ID_COUNT)).size();
+                    } else {
+                        found += snapshot.getFirstObject<BenchDerivedObject>() != nullptr;
+                    }
+                } else if (i % 2) {
+                    found += pool.getObjects(ids.at(i % ID_COUNT)).size();
+                } else {
+                    found += pool.getFirstObject<BenchDerivedObject>() != nullptr;
+                }
+            }
+            sink += found;
+            readOps += n;
+        });
+    }
+
+    // One writer keeps adding and removing objects
+    threads.emplace_back([&]() {
+        qint64 n = 0;
+        for (int i = 0; !stop.load(std::memory_order_relaxed); ++i) {
+            auto obj = extraObjs.at(i % ID_COUNT);
+            pool.addObject(ids.at(i % ID_COUNT), obj);
+            pool.removeObject(obj);
+            n += 2;
+        }
+        writeOps += n;
+    });
+
+    QElapsedTimer timer;
+    timer.start();
+    QThread::msleep(durationMs);
+    stop = true;
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    qint64 elapsed = timer.nsecsElapsed();
+
+    // Throughput of all threads of a kind together
+    if (snapshots) {
+        report("contention.snapshotRead", count, readOps, elapsed, readers);
+        report("contention.write(snapshots)", count, writeOps, elapsed, 1);
+    } else {
+        report("contention.read", count, readOps, elapsed, readers);
+        report("contention.write", count, writeOps, elapsed, 1);
+    }
+
+    pool.removeObjects(ObjectPool::Id());
+    for (const auto &id : ids) {
+        pool.removeObjects(id);
+    }
+    qDeleteAll(objs);
+    qDeleteAll(extraObjs);
+}
+
+// Typed lookups of a class making up 0.5% of the pool, answered from the index in O(k), compared
+// with the scan of all objects that they used to be
+static void benchRareType(int count, int lookups) {
+    const int rareCount = qMax(1, count / 200);
+    auto objs = createObjects(count - rareCount);
+    for (int i = 0; i < rareCount; ++i) {
+        objs.append(new BenchRareObject(i));
+    }
+
+    ObjectPool pool;
+    {
+        ObjectPool::Batch batch(&pool);
+        for (const auto &obj : qAsConst(objs)) {
+            batch.addObject(obj);
+        }
+    }
+
+    const int scanLookups = qMax(10, int(qint64(lookups) * 1000 / count));
+
+    report("getObjects<T>(rare)", count, lookups, measure([&]() {
+               qint64 n = 0;
+               for (int i = 0; i < lookups; ++i) {
+                   n += pool.getObjects<BenchRareObject>().size();
+               }
+               sink += n;
+           }));
+    Bench::annotate({{"matches", rareCount}});
+
+    report("forEachObject<T>(rare)", count, lookups, measure([&]() {
+               qint64 n = 0;
+               for (int i = 0; i < lookups; ++i) {
+                   pool.forEachObject<BenchRareObject>([&n](BenchRareObject *obj) {
+                       n += obj->value; //
+                   });
+               }
+               sink += n;
+           }));
+    Bench::annotate({{"matches", rareCount}});
+
+    report("allObjects()+qobject_cast(rare)", count, scanLookups, measure([&]() {
+               qint64 n = 0;
+               for (int i = 0; i < scanLookups; ++i) {
+                   for (const auto &obj : pool.allObjects()) {
+                       n += qobject_cast<BenchRareObject *>(obj) != nullptr;
+                   }
+               }
+               sink += n;
+           }));
+    Bench::annotate({{"matches", rareCount}});
+
+    pool.removeObjects(ObjectPool::Id());
+    qDeleteAll(objs);
+}
+
+// Lookups by name, resolved against the ids of the pool, compared with lookups by id in one
+// thread and in several threads at once
+static void benchNameLookups(int count, int lookups, int threads) {
+    const auto ids = createIds();
+    QStringList names;
+    for (const auto &id : ids) {
+        names.append(id.toString());
+    }
+    const auto objs = createObjects(count);
+
+    ObjectPool pool;
+    {
+        ObjectPool::Batch batch(&pool);
+        for (int i = 0; i < count; ++i) {
+            batch.addObject(ids.at(i % ID_COUNT), objs.at(i));
+        }
+    }
+
+    auto run = [&](bool byName, int offset) {
+        qint64 n = 0;
+        for (int i = offset; i < offset + lookups; ++i) {
+            n += (byName ? pool.getFirstObject(names.at(i % ID_COUNT))
+                         : pool.getFirstObject(ids.at(i % ID_COUNT))) != nullptr;
+        }
+        sink += n;
+    };
+    auto concurrent = [&](bool byName) {
+        return measure([&]() {
+            std::vector<std::thread> workers;
+            for (int t = 0; t < threads; ++t) {
+                workers.emplace_back(run, byName, t);
+            }
+            for (auto &worker : workers) {
+                worker.join();
+            }
+        });
+    };
+
+    report("getFirstObject(id)", count, lookups, measure([&]() { run(false, 0); }));
+    report("getFirstObject(QString)", count, lookups, measure([&]() { run(true, 0); }));
+    report("getFirstObject(id)", count, qint64(lookups) * threads, concurrent(false), threads);
+    report("getFirstObject(QString)", count, qint64(lookups) * threads, concurrent(true),
+           threads);
+
+    pool.removeObjects(ObjectPool::Id());
+    for (const auto &id : ids) {
+        pool.removeObjects(id);
+    }
+    qDeleteAll(objs);
+}
+
+// Lookups through a chain of pools, the objects are in the root pool. The cached results are
+// hit from several threads at once, then invalidated by a modification of the root before each
+// lookup.
+static void benchChainLookups(int count, int lookups, int threads) {
+    const auto ids = createIds();
+    const auto objs = createObjects(count);
+    QObject extraObj;
+
+    ObjectPool root;
+    {
+        ObjectPool::Batch batch(&root);
+        for (int i = 0; i < count; ++i) {
+            batch.addObject(ids.at(i % ID_COUNT), objs.at(i));
+        }
+    }
+    ObjectPool middle;
+    ObjectPool leaf;
+    middle.setParentPool(&root);
+    leaf.setParentPool(&middle);
+
+    report("lookup(id)", count, qint64(lookups) * threads, measure([&]() {
+               std::vector<std::thread> workers;
+               for (int t = 0; t < threads; ++t) {
+                   workers.emplace_back([&, t]() {
+                       qint64 n = 0;
+                       for (int i = t; i < t + lookups; ++i) {
+                           n += leaf.lookup(ids.at(i % ID_COUNT)) != nullptr;
+                       }
+                       sink += n;
+                   });
+               }
+               for (auto &worker : workers) {
+                   worker.join();
+               }
+           }),
+           threads);
+
+    const int modifications = qMin(lookups, 1000);
+    report("lookup(id) after modification", count, modifications, measure([&]() {
+               qint64 n = 0;
+               for (int i = 0; i < modifications; ++i) {
+                   if (i % 2) {
+                       root.removeObject(&extraObj);
+                   } else {
+                       root.addObject(&extraObj);
+                   }
+                   n += leaf.lookup(ids.at(i % ID_COUNT)) != nullptr;
+               }
+               sink += n;
+           }));
+
+    leaf.setParentPool(nullptr);
+    middle.setParentPool(nullptr);
+    root.removeObjects(ObjectPool::Id());
+    for (const auto &id : ids) {
+        root.removeObjects(id);
+    }
+    qDeleteAll(objs);
+}
+
+// Single additions to a full pool once a snapshot has been requested, and additions each followed
+// by a snapshot, which is rebuilt for every one of them
+static void benchSnapshotAdditions(int count) {
+    const auto ids = createIds();
+    const auto objs = createObjects(count);
+    const int additions = qMin(count, 1000);
+    const auto extraObjs = createObjects(additions * 2);
+
+    ObjectPool pool;
+    {
+        ObjectPool::Batch batch(&pool);
+        for (int i = 0; i < count; ++i) {
+            batch.addObject(ids.at(i % ID_COUNT), objs.at(i));
+        }
+    }
+    sink += pool.snapshot().allObjects().size();
+
+    report("addObject(after snapshot)", count, additions, measure([&]() {
+               for (int i = 0; i < additions; ++i) {
+                   pool.addObject(ids.at(i % ID_COUNT), extraObjs.at(i));
+               }
+           }));
+
+    report("addObject+snapshot()", count, additions, measure([&]() {
+               qint64 n = 0;
+               for (int i = 0; i < additions; ++i) {
+                   pool.addObject(ids.at(i % ID_COUNT), extraObjs.at(additions + i));
+                   n += pool.snapshot().allObjects().size();
+               }
+               sink += n;
+           }));
+
+    report("snapshot()", count, additions, measure([&]() {
+               qint64 n = 0;
+               for (int i = 0; i < additions; ++i) {
+                   n += pool.snapshot().allObjects().size();
+               }
+               sink += n;
+           }));
+
+    pool.removeObjects(ObjectPool::Id());
+    for (const auto &id : ids) {
+        pool.removeObjects(id);
+    }
+    qDeleteAll(objs);
+    qDeleteAll(extraObjs);
+}
+
+// Objects added and removed under ids built at run time, returns false if the atoms of the ids
+// outlive the objects
+static bool benchRuntimeIds(int count, int rounds) {
+    const auto objs = createObjects(count);
+    ObjectPool pool;
+
+    const int atomsBefore = ObjectPool::Id::atomCount();
+    qint64 firstRoundBytes = -1;
+    qint64 elapsed = 0;
+    for (int r = 0; r < rounds; ++r) {
+        elapsed += measure([&]() {
+            for (int i = 0; i < count; ++i) {
+                pool.addObject(QStringLiteral("bench.runtime.%1.%2").arg(r).arg(i), objs.at(i));
+            }
+            for (const auto &obj : objs) {
+                pool.removeObject(obj);
+            }
+        });
+        if (r == 0)
+            firstRoundBytes = residentBytes();
+    }
+    const int atomsAfter = ObjectPool::Id::atomCount();
+    const qint64 lastRoundBytes = residentBytes();
+
+    bool found;
+    ObjectPool::Id::lookup(QStringLiteral("bench.runtime.0.0"), &found);
+    bool ok = atomsAfter == atomsBefore && !found;
+    if (!ok) {
+        fprintf(stderr, "runtimeIds: %d atoms left of %d ids\n", atomsAfter - atomsBefore,
+                count * rounds);
+    }
+
+    // The resident size is expected to stay flat after the first round
+    report("addObject(QString)+removeObject", count, qint64(count) * rounds, elapsed);
+    Bench::annotate({{"rounds", rounds},
+                     {"atomsLeft", atomsAfter - atomsBefore},
+                     {"residentGrowthBytes", firstRoundBytes < 0 || lastRoundBytes < 0
+                                                 ? -1.0
+                                                 : double(lastRoundBytes - firstRoundBytes)},
+                     {"ok", ok}});
+
+    qDeleteAll(objs);
+    return ok;
+}
+
+// Stress test of the lock-free staging, every object is posted twice under different ids and
+// must be added once. Returns false if objects are lost or duplicated, if listeners are not
+// notified in the pool's thread or if a handle still resolves after its object is destroyed.
+static bool benchPostObject(int count, int producers) {
+    const int perProducer = qMax(1, count / producers);
+    const int total = perProducer * producers;
+    const auto objs = createObjects(total);
+    const ObjectPool::Id duplicateId(QStringLiteral("bench.duplicate"));
+
+    ObjectPool pool;
+    int added = 0;
+    int batches = 0;
+    bool wrongThread = false;
+    QObject::connect(&pool, &ObjectPool::objectsAdded, &pool,
+                     [&](const QList<QPair<QString, QObject *>> &list) {
+                         added += list.size();
+                         batches++;
+                         wrongThread |= QThread::currentThread() != pool.thread();
+                     });
+
+    // The rejected duplicates are expected, keep their warnings out of the output
+    auto messageHandler = qInstallMessageHandler(
+        [](QtMsgType, const QMessageLogContext &, const QString &) {});
+
+    QElapsedTimer timer;
+    timer.start();
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p]() {
+            for (int i = p * perProducer; i < (p + 1) * perProducer; ++i) {
+                pool.postObject(objs.at(i));
+                pool.postObject(duplicateId, objs.at(i));
+            }
+        });
+    }
+
+    QElapsedTimer timeout;
+    timeout.start();
+    while (added < total && timeout.elapsed() < 30000) {
+        QCoreApplication::processEvents();
+    }
+    qint64 elapsed = timer.nsecsElapsed();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    // Drain what may be left after a timeout
+    pool.flushPostedObjects();
+
+    bool ok = added == total && !wrongThread && pool.allObjects().size() == total;
+    if (!ok) {
+        fprintf(stderr, "postObject: %d of %d objects added, %s\n", added, total,
+                wrongThread ? "notified in a wrong thread" : "notified in the pool's thread");
+    }
+
+    report("postObject", total, total * 2, elapsed, producers);
+    Bench::annotate({{"batches", batches}, {"ok", ok}});
+
+    // Adding again under another id is rejected and keeps the handle, which is invalidated when
+    // the object is destroyed
+    QList<ObjectPool::Handle> handles;
+    int handleErrors = 0;
+    for (const auto &obj : objs) {
+        auto handle = pool.handleOf(obj);
+        pool.addObject(duplicateId, obj);
+        handleErrors += handle.isNull() || pool.handleOf(obj) != handle;
+        handles.append(handle);
+    }
+    qInstallMessageHandler(messageHandler);
+    qDeleteAll(objs);
+    for (const auto &handle : std::as_const(handles)) {
+        handleErrors += pool.resolve(handle) != nullptr;
+    }
+    if (handleErrors || !pool.getObjects(duplicateId).isEmpty() || !pool.allObjects().isEmpty()) {
+        fprintf(stderr, "postObject: %d handle errors, %d duplicates left\n", handleErrors,
+                int(pool.getObjects(duplicateId).size()));
+        ok = false;
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+
+    Bench::CommandLine cmd(QStringLiteral("ChorusKit ObjectPool benchmark"));
+    cmd.addSizesOption(QStringLiteral("1000,10000,100000"),
+                       QStringLiteral("Comma separated pool sizes."));
+    auto lookupsOption =
+        cmd.addOption(QStringLiteral("lookups"), QStringLiteral("Iterations of lookups by id."),
+                      QStringLiteral("count"), QStringLiteral("10000"));
+    auto threadsOption = cmd.addOption(
+        QStringLiteral("threads"), QStringLiteral("Reader and producer threads."),
+        QStringLiteral("count"), QString::number(qMax(2, QThread::idealThreadCount() - 1)));
+    auto durationOption = cmd.addOption(QStringLiteral("duration"),
+                                        QStringLiteral("Duration of each contention run."),
+                                        QStringLiteral("ms"), QStringLiteral("500"));
+    cmd.process(a);
+
+    const int lookups = cmd.intValue(lookupsOption);
+    const int threads = cmd.intValue(threadsOption);
+    const int duration = cmd.intValue(durationOption);
+
+    bool ok = true;
+    for (int size : cmd.sizes()) {
+        benchSingleThread(size, lookups);
+        benchRareType(size, lookups);
+        benchNameLookups(size, lookups, threads);
+        benchChainLookups(size, lookups, threads);
+        benchContention(size, threads, duration, false);
+        benchContention(size, threads, duration, true);
+        benchSnapshotAdditions(size);
+        ok &= benchPostObject(size, threads);
+        ok &= benchRuntimeIds(size, 10);
+    }
+    return cmd.write(QStringLiteral("objectpool"), ok,
+                     {{"idealThreadCount", QThread::idealThreadCount()}});
+}
@@ -0,0 +1,146 @@
+#include <thread>
+#include <vector>
+
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QThread>
+
+#include <CoreApi/objectpool.h>
+
+// Stress test of ObjectPool::postObject(). Producer threads create objects and post them while
+// the pool's thread drains them, by its event loop and by flushPostedObjects() in turn. Every
+// posted object must be added exactly once, in the pool's thread and under the id it was posted
+// with.
+
+using Core::ObjectPool;
+
+static const int ID_COUNT = 3;
+
+// Returns the number of errors
+static int runRound(int round, int producers, int perProducer) {
+    const ObjectPool::Id ids[ID_COUNT] = {
+        ObjectPool::Id(),
+        ObjectPool::Id(QStringLiteral("posttest.a")),
+        ObjectPool::Id(QStringLiteral("posttest.b")),
+    };
+    const int total = producers * perProducer;
+
+    ObjectPool pool;
+    QHash<QObject *, int> arrivals;
+    int added = 0;
+    int wrongThread = 0;
+    int wrongId = 0;
+    QObject::connect(&pool, &ObjectPool::objectsAdded, &pool,
+                     [&](const QList<QPair<QString, QObject *>> &list) {
+                         for (const auto &item : list) {
+                             arrivals[item.second]++;
+                             wrongId += item.first != item.second->objectName();
+                         }
+                         added += list.size();
+                         wrongThread += QThread::currentThread() != pool.thread();
+                     });
+
+    // The objects are created and named in the producers, which keep them until the end
+    std::vector<std::vector<QObject *>> objs(producers);
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p]() {
+            auto &list = objs[p];
+            list.reserve(perProducer);
+            for (int i = 0; i < perProducer; ++i) {
+                auto obj = new QObject();
+                const auto &id = ids[(p + i) % ID_COUNT];
+                obj->setObjectName(id.toString());
+                list.push_back(obj);
+                if (i % 2) {
+                    pool.postObject(id, obj);
+                } else {
+                    pool.postObject(id.toString(), obj);
+                }
+            }
+        });
+    }
+
+    QElapsedTimer timeout;
+    timeout.start();
+    for (int i = 0; added < total && timeout.elapsed() < 30000; ++i) {
+        if (i % 2) {
+            pool.flushPostedObjects();
+        } else {
+            QCoreApplication::processEvents();
+        }
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    // Nothing may arrive after all of them did
+    pool.flushPostedObjects();
+    QCoreApplication::processEvents();
+
+    int errors = 0;
+    int missing = 0;
+    int duplicated = 0;
+    for (const auto &list : objs) {
+        for (const auto &obj : list) {
+            const int n = arrivals.value(obj);
+            missing += n == 0;
+            duplicated += n > 1;
+        }
+    }
+    errors += missing + duplicated + wrongThread + wrongId;
+    if (added != total || pool.allObjects().size() != total) {
+        errors++;
+    }
+    if (errors) {
+        fprintf(stderr,
+                "round %d: %d of %d objects added, %d in the pool, %d missing, %d duplicated, "
+                "%d notifications in a wrong thread, %d under a wrong id\n",
+                round, added, total, int(pool.allObjects().size()), missing, duplicated,
+                wrongThread, wrongId);
+    }
+
+    for (const auto &list : objs) {
+        qDeleteAll(list);
+    }
+    if (!pool.allObjects().isEmpty()) {
+        fprintf(stderr, "round %d: %d objects left after their destruction\n", round,
+                int(pool.allObjects().size()));
+        errors++;
+    }
+    return errors;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("ChorusKit ObjectPool posting stress test"));
+    parser.addHelpOption();
+    QCommandLineOption producersOption(
+        QStringLiteral("producers"), QStringLiteral("Producer threads."), QStringLiteral("count"),
+        QString::number(qBound(2, QThread::idealThreadCount(), 8)));
+    QCommandLineOption objectsOption(QStringLiteral("objects"),
+                                     QStringLiteral("Objects posted by each producer."),
+                                     QStringLiteral("count"), QStringLiteral("20000"));
+    QCommandLineOption roundsOption(QStringLiteral("rounds"), QStringLiteral("Rounds."),
+                                    QStringLiteral("count"), QStringLiteral("5"));
+    parser.addOption(producersOption);
+    parser.addOption(objectsOption);
+    parser.addOption(roundsOption);
+    parser.process(a);
+
+    const int producers = qMax(1, parser.value(producersOption).toInt());
+    const int perProducer = qMax(1, parser.value(objectsOption).toInt());
+    const int rounds = qMax(1, parser.value(roundsOption).toInt());
+
+    int errors = 0;
+    for (int round = 0; round < rounds; ++round) {
+        errors += runRound(round, producers, perProducer);
+    }
+    printf("%d rounds of %d objects from %d producers: %d errors\n", rounds,
+           producers * perProducer, producers, errors);
+    return errors ? 1 : 0;
+}
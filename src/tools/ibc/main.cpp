@@ -0,0 +1,120 @@
+#include <QtCore/QCommandLineOption>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+
+#include "parser.h"
+#include "writer.h"
+
+void error(const char *msg = "Invalid argument") {
+    if (msg)
+        fprintf(stderr, "%s: %s\n", qPrintable(qApp->applicationName()), msg);
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationVersion(QString::fromLatin1(APP_VERSION));
+
+    // Build command line parser
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        QStringLiteral("ChorusKit Icon Bundle Compiler version %1 (Qt %2)")
+            .arg(QString::fromLatin1(APP_VERSION), QString::fromLatin1(QT_VERSION_STR)));
+    parser.setSingleDashWordOptionMode(QCommandLineParser::ParseAsLongOptions);
+
+    QCommandLineOption outputOption(QStringLiteral("o"));
+    outputOption.setDescription(
+        QStringLiteral("Write bundles to directory rather than the current directory."));
+    outputOption.setValueName(QStringLiteral("dir"));
+    outputOption.setFlags(QCommandLineOption::ShortOptionStyle);
+    parser.addOption(outputOption);
+
+    QCommandLineOption themeOption(QStringLiteral("t"));
+    themeOption.setDescription(QStringLiteral("Write the bundle of the theme only."));
+    themeOption.setValueName(QStringLiteral("theme"));
+    parser.addOption(themeOption);
+
+    QCommandLineOption defineOption(QStringLiteral("D"));
+    defineOption.setDescription(QStringLiteral("Define a variable."));
+    defineOption.setValueName(QStringLiteral("macro[=def]"));
+    defineOption.setFlags(QCommandLineOption::ShortOptionStyle);
+    parser.addOption(defineOption);
+
+    parser.addPositionalArgument(QStringLiteral("<file>"),
+                                 QStringLiteral("Icon configuration file to read from."));
+
+    parser.addHelpOption();
+    parser.addVersionOption();
+
+    if (argc == 1) {
+        parser.showHelp(0);
+    }
+    parser.process(QCoreApplication::arguments());
+
+    // Parse command line arguments
+    Parser pp;
+    QString filename;
+    if (const QStringList files = parser.positionalArguments(); files.count() > 1) {
+        error(qPrintable(QLatin1String("Too many input files specified: '") +
+                         files.join(QLatin1String("' '")) + QLatin1Char('\'')));
+        parser.showHelp(1);
+    } else if (files.isEmpty()) {
+        error(qPrintable(QLatin1String("Input file not specified.")));
+        parser.showHelp(1);
+    } else {
+        filename = files.first();
+        pp.fileName = filename;
+    }
+
+    for (const QString &arg : parser.values(defineOption)) {
+        QByteArray name = arg.toLocal8Bit();
+        QByteArray value = name;
+        int eq = name.indexOf('=');
+        if (eq >= 0) {
+            value = name.mid(eq + 1);
+            name = name.left(eq);
+        }
+        if (name.isEmpty()) {
+            error("Missing macro name");
+            parser.showHelp(1);
+        }
+        pp.variables.insert(QString::fromLatin1(name), QString::fromLatin1(value));
+    }
+
+    QDir outputDir(parser.isSet(outputOption) ? parser.value(outputOption) : QDir::currentPath());
+    if (!outputDir.mkpath(QStringLiteral("."))) {
+        fprintf(stderr, "%s: Cannot create %s\n", qPrintable(qApp->applicationName()),
+                QFile::encodeName(outputDir.path()).constData());
+        return 1;
+    }
+
+    // Parse XML file
+    QFile in;
+    in.setFileName(filename);
+    if (!in.open(QIODevice::ReadOnly)) {
+        fprintf(stderr, "%s: %s: No such file\n", qPrintable(qApp->applicationName()),
+                qPrintable(filename));
+        return 1;
+    }
+
+    // If there's error, the program will exit right away.
+    auto message = pp.parse(in.readAll());
+
+    // Write one bundle per theme, named after the configuration and the theme
+    auto baseName = QFileInfo(filename).completeBaseName();
+    for (auto it = message.icons.begin(); it != message.icons.end(); ++it) {
+        const auto &theme = it.key();
+        if (parser.isSet(themeOption) && theme != parser.value(themeOption))
+            continue;
+
+        auto output = outputDir.filePath(
+            (theme.isEmpty() ? baseName : baseName + QLatin1Char('-') + theme) +
+            QStringLiteral(".ckib"));
+        if (!Writer(theme, it.value()).write(output))
+            return 1;
+    }
+
+    return 0;
+}
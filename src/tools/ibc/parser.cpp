@@ -0,0 +1,155 @@
+#include "parser.h"
+
+#include <cstdlib>
+#include <list>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFileInfo>
+#include <QtCore/QRegularExpression>
+#include <QtCore/QStringView>
+
+#include <qmxmladaptor.h>
+
+// Same as the parser of the icon configurations in ActionDomain, keep them in sync
+
+static QString parseExpression(QString s, const QHash<QString, QString> &vars) {
+    static QRegularExpression reg(QStringLiteral(R"((?<!\$)(?:\$\$)*\$\{(\w+)\})"));
+    bool hasMatch;
+    do {
+        hasMatch = false;
+
+        QString result;
+        QRegularExpressionMatch match;
+        int index = 0;
+        int lastIndex = 0;
+        while ((index = s.indexOf(reg, index, &match)) != -1) {
+            hasMatch = true;
+            result += QStringView(s).mid(lastIndex, index - lastIndex);
+
+            const auto &name = match.captured(1);
+            QString val;
+            auto it = vars.find(name);
+            if (it == vars.end()) {
+                val = name;
+            } else {
+                val = it.value();
+            }
+
+            result += val;
+            index += match.captured(0).size();
+            lastIndex = index;
+        }
+        result += QStringView(s).mid(lastIndex);
+        s = result;
+    } while (hasMatch);
+    s.replace(QStringLiteral("$$"), QStringLiteral("$"));
+    return s;
+}
+
+struct ParserPrivate {
+    QString fileName;
+    QHash<QString, QString> variables;
+
+    struct ParserConfig {
+        QString baseDirectory;
+    };
+
+    inline QString resolve(const QString &s) const {
+        return parseExpression(s, variables);
+    }
+
+    void error(const char *msg) const {
+        fprintf(stderr, "%s: %s: %s\n", qPrintable(qApp->applicationName()),
+                qPrintable(fileName), msg);
+        std::exit(1);
+    }
+
+    IconConfigurationMessage parse(const QByteArray &data) {
+        QMXmlAdaptor xml;
+        if (!xml.loadData(data)) {
+            error("invalid format");
+        }
+
+        const auto &root = xml.root;
+        if (root.name != QStringLiteral("iconConfiguration")) {
+            error(qPrintable(QStringLiteral("unknown root element tag \"%1\"").arg(root.name)));
+        }
+
+        bool hasParserConfig = false;
+        ParserConfig parserConfig;
+        parserConfig.baseDirectory = QFileInfo(fileName).absolutePath();
+
+        QList<const QMXmlAdaptorElement *> iconsElements;
+        for (const auto &item : std::as_const(root.children)) {
+            if (item->name == QStringLiteral("icons")) {
+                iconsElements.append(item.data());
+                continue;
+            }
+            if (item->name == QStringLiteral("parserConfig")) {
+                if (hasParserConfig) {
+                    error("duplicated parser config elements");
+                }
+                parserConfig = parseParserConfig(*item);
+                hasParserConfig = true;
+                continue;
+            }
+        }
+
+        IconConfigurationMessage result;
+        for (const auto &item : std::as_const(iconsElements)) {
+            auto theme = item->properties.value(QStringLiteral("theme"));
+            std::list<const QMXmlAdaptorElement *> stack;
+            for (const auto &child : item->children) {
+                stack.push_back(child.data());
+            }
+
+            auto &themeMap = result.icons[theme];
+            while (!stack.empty()) {
+                auto e = stack.front();
+                stack.pop_front();
+
+                auto id = resolve(e->properties.value(QStringLiteral("id")));
+                if (!id.isEmpty()) {
+                    auto file = resolve(e->properties.value(QStringLiteral("file")));
+                    if (!file.isEmpty()) {
+                        file.replace(QStringLiteral(":/"), parserConfig.baseDirectory);
+                        themeMap[id] = file;
+                    }
+                }
+
+                for (const auto &child : e->children) {
+                    stack.push_back(child.data());
+                }
+            }
+        }
+        return result;
+    }
+
+    ParserConfig parseParserConfig(const QMXmlAdaptorElement &e) {
+        ParserConfig result;
+
+        for (const auto &item : e.children) {
+            if (item->name == QStringLiteral("baseDirectory")) {
+                result.baseDirectory = resolve(item->value);
+                continue;
+            }
+
+            if (item->name == QStringLiteral("vars")) {
+                for (const auto &subItem : item->children) {
+                    auto key = resolve(subItem->properties.value(QStringLiteral("key")));
+                    auto value = resolve(subItem->properties.value(QStringLiteral("value")));
+                    if (!key.isEmpty()) {
+                        variables.insert(key, value);
+                    }
+                }
+            }
+        }
+        return result;
+    }
+};
+
+Parser::Parser() = default;
+
+IconConfigurationMessage Parser::parse(const QByteArray &data) const {
+    return ParserPrivate{fileName, variables}.parse(data);
+}
@@ -0,0 +1,22 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <QtCore/QHash>
+#include <QtCore/QString>
+
+struct IconConfigurationMessage {
+    // theme -> id -> file
+    QHash<QString, QHash<QString, QString>> icons;
+};
+
+class Parser {
+public:
+    Parser();
+
+    QString fileName;
+    QHash<QString, QString> variables;
+
+    IconConfigurationMessage parse(const QByteArray &data) const;
+};
+
+#endif // PARSER_H
@@ -0,0 +1,109 @@
+#include "writer.h"
+
+#include <algorithm>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSaveFile>
+#include <QtCore/QtEndian>
+
+// Icon bundles, all integers are little-endian 32-bit words, read by ActionDomain::addIconBundle()
+//
+//   header:    magic, version, entry count, string data size, blob data size,
+//              theme offset, theme length
+//   entries:   id offset, id length, format offset, format length, blob offset, blob size
+//   string data, UTF-8 strings addressed by byte offset and length
+//   blob data, the image files as they are on disk
+static const char IconBundleMagic[] = {'C', 'K', 'I', 'B'};
+static const quint32 IconBundleVersion = 1;
+
+static void appendWord(QByteArray &data, quint32 value) {
+    char buf[4];
+    qToLittleEndian(value, buf);
+    data.append(buf, 4);
+}
+
+static void align(QByteArray &data) {
+    while (data.size() % 4) {
+        data.append('\0');
+    }
+}
+
+Writer::Writer(const QString &theme, const QHash<QString, QString> &icons)
+    : theme(theme), icons(icons) {
+}
+
+bool Writer::write(const QString &output) {
+    // Sorted to keep the output stable
+    auto ids = icons.keys();
+    std::sort(ids.begin(), ids.end());
+
+    QByteArray strings;
+    QByteArray blobs;
+    QHash<QByteArray, quint32> stringOffsets;
+    QHash<QByteArray, quint32> blobOffsets;
+    auto addString = [&](const QByteArray &s) {
+        auto it = stringOffsets.find(s);
+        if (it == stringOffsets.end()) {
+            it = stringOffsets.insert(s, quint32(strings.size()));
+            strings.append(s);
+        }
+        return it.value();
+    };
+
+    QByteArray entries;
+    for (const auto &id : std::as_const(ids)) {
+        const auto &fileName = icons.value(id);
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly)) {
+            fprintf(stderr, "%s: %s: No such file\n", qPrintable(qApp->applicationName()),
+                    qPrintable(fileName));
+            return false;
+        }
+
+        auto idData = id.toUtf8();
+        auto format = QFileInfo(fileName).suffix().toLower().toLatin1();
+        appendWord(entries, addString(idData));
+        appendWord(entries, quint32(idData.size()));
+        appendWord(entries, addString(format));
+        appendWord(entries, quint32(format.size()));
+
+        // Identical files are stored once
+        auto data = file.readAll();
+        auto it = blobOffsets.find(data);
+        if (it == blobOffsets.end()) {
+            align(blobs);
+            it = blobOffsets.insert(data, quint32(blobs.size()));
+            blobs.append(data);
+        }
+        appendWord(entries, it.value());
+        appendWord(entries, quint32(data.size()));
+    }
+
+    auto themeData = theme.toUtf8();
+    auto themeOffset = addString(themeData);
+    align(strings);
+    align(blobs);
+
+    QByteArray header;
+    header.append(IconBundleMagic, sizeof(IconBundleMagic));
+    appendWord(header, IconBundleVersion);
+    appendWord(header, quint32(ids.size()));
+    appendWord(header, quint32(strings.size()));
+    appendWord(header, quint32(blobs.size()));
+    appendWord(header, themeOffset);
+    appendWord(header, quint32(themeData.size()));
+
+    QSaveFile out(output);
+    if (!out.open(QIODevice::WriteOnly)) {
+        fprintf(stderr, "%s: Cannot create %s\n", qPrintable(qApp->applicationName()),
+                QFile::encodeName(output).constData());
+        return false;
+    }
+    out.write(header);
+    out.write(entries);
+    out.write(strings);
+    out.write(blobs);
+    return out.commit();
+}
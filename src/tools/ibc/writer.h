@@ -0,0 +1,18 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <QtCore/QHash>
+#include <QtCore/QString>
+
+class Writer {
+public:
+    Writer(const QString &theme, const QHash<QString, QString> &icons);
+
+    bool write(const QString &output);
+
+private:
+    QString theme;
+    QHash<QString, QString> icons;
+};
+
+#endif // WRITER_H